@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D screenTexture;
+// size of a texel of screenTexture
+uniform vec2 texelSize;
+
+// dual Kawase downsample: the center and four diagonal bilinear taps
+void main()
+{
+	vec2 h = texelSize;
+	vec3 col = texture(screenTexture, TexCoords).rgb * 4.0;
+	col += texture(screenTexture, TexCoords + vec2(-h.x, -h.y)).rgb;
+	col += texture(screenTexture, TexCoords + vec2( h.x, -h.y)).rgb;
+	col += texture(screenTexture, TexCoords + vec2(-h.x,  h.y)).rgb;
+	col += texture(screenTexture, TexCoords + vec2( h.x,  h.y)).rgb;
+	FragColor = vec4(col / 8.0, 1.0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D screenTexture;
+uniform vec2 texelSize;
+// x: threshold, y: knee, z: 2 * knee, w: 0.25 / knee
+uniform vec4 curve;
+
+void main()
+{
+	// 4 bilinear taps average a 4x4 block, which keeps single bright pixels
+	// from flickering as they move
+	vec4 d = texelSize.xyxy * vec4(-1.0, -1.0, 1.0, 1.0);
+	vec3 col = texture(screenTexture, TexCoords + d.xy).rgb;
+	col += texture(screenTexture, TexCoords + d.zy).rgb;
+	col += texture(screenTexture, TexCoords + d.xw).rgb;
+	col += texture(screenTexture, TexCoords + d.zw).rgb;
+	col *= 0.25;
+
+	// soft knee: a quadratic ramp around the threshold instead of a hard cut
+	float brightness = max(col.r, max(col.g, col.b));
+	float soft = clamp(brightness - curve.x + curve.y, 0.0, curve.z);
+	soft = soft * soft * curve.w;
+	float contribution = max(soft, brightness - curve.x) / max(brightness, 0.00001);
+	FragColor = vec4(col * contribution, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D screenTexture;
+// size of a texel of screenTexture
+uniform vec2 texelSize;
+
+// dual Kawase upsample: a ring of eight bilinear taps, edges weighted 1 and
+// diagonals 2
+void main()
+{
+	vec2 h = texelSize;
+	vec3 col = texture(screenTexture, TexCoords + vec2(-2.0 * h.x, 0.0)).rgb;
+	col += texture(screenTexture, TexCoords + vec2( 2.0 * h.x, 0.0)).rgb;
+	col += texture(screenTexture, TexCoords + vec2(0.0, -2.0 * h.y)).rgb;
+	col += texture(screenTexture, TexCoords + vec2(0.0,  2.0 * h.y)).rgb;
+	col += texture(screenTexture, TexCoords + vec2(-h.x, -h.y)).rgb * 2.0;
+	col += texture(screenTexture, TexCoords + vec2( h.x, -h.y)).rgb * 2.0;
+	col += texture(screenTexture, TexCoords + vec2(-h.x,  h.y)).rgb * 2.0;
+	col += texture(screenTexture, TexCoords + vec2( h.x,  h.y)).rgb * 2.0;
+	FragColor = vec4(col / 12.0, 1.0);
+}
@@ -1,46 +0,0 @@
-#version 330 core
-out vec4 FragColor;
-  
-in vec2 TexCoords;
-
-uniform sampler2D screenTexture;
-
-const float offset = 1.0 / 75.0;  
-// const float offset = 1.0 / 150.0;
-
-void main()
-{
-    vec2 offsets[9] = vec2[](
-        vec2(-offset,  offset), // top-left
-        vec2( 0.0f,    offset), // top-center
-        vec2( offset,  offset), // top-right
-        vec2(-offset,  0.0f),   // center-left
-        vec2( 0.0f,    0.0f),   // center-center
-        vec2( offset,  0.0f),   // center-right
-        vec2(-offset, -offset), // bottom-left
-        vec2( 0.0f,   -offset), // bottom-center
-        vec2( offset, -offset)  // bottom-right    
-    );
-
-	float kernel[9] = float[](
-		1.0 / 16, 2.0 / 16, 1.0 / 16,
-		2.0 / 16, 4.0 / 16, 2.0 / 16,
-		1.0 / 16, 2.0 / 16, 1.0 / 16  
-	);
-    
-    vec3 sampleTex[9];
-    for(int i = 0; i < 9; i++)
-    {
-        vec2 sample = vec2(clamp(TexCoords.s + offsets[i].x, 0.001, 0.999), clamp(TexCoords.t + offsets[i].y, 0.001, 0.999));
-        sampleTex[i] = vec3(texture(screenTexture, sample));
-    }
-    vec3 col = vec3(0.0);
-    for(int i = 0; i < 9; i++)
-        col += sampleTex[i] * kernel[i];
-    
-    if (col.b == 1.0) {
-        FragColor = vec4(col.r, col.g, 0.0, 0.0);
-    } else {
-        FragColor = vec4(1.0, 0.5, 0.0, (1-col.b)*2);
-    }
-}  
\ No newline at end of file
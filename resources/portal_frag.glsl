@@ -0,0 +1,14 @@
+#version 330 core
+uniform sampler2D Texture0;
+// maps texture coordinates for the current portal view to where the same
+// direction was in the last rendered portal image
+uniform mat3 Reproject;
+
+in vec2 vTexCoord;
+out vec4 Outcolor;
+
+void main() {
+	vec3 h = Reproject * vec3(vTexCoord, 1.0);
+	vec2 uv = h.z > 0.0 ? h.xy / h.z : vTexCoord;
+	Outcolor = texture(Texture0, uv);
+}
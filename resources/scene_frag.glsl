@@ -0,0 +1,84 @@
+#version 330 core
+// Compiled per variant with LIGHTS (point lights, 0 for unlit) and TEXTURED
+// defined, see ShaderVariants
+out vec4 color;
+
+#ifdef TEXTURED
+uniform sampler2D Texture0;
+in vec2 vTexCoord;
+#else
+uniform vec3 MatAmb;
+uniform vec3 MatDif;
+uniform vec3 MatSpec;
+uniform float MatShine;
+#endif
+uniform vec3 camPos;
+
+in vec3 fragNor;
+//position of the vertex in world space
+in vec3 EPos;
+#if LIGHTS > 0
+in vec3 lightDir[LIGHTS];
+in float viewDepth;
+
+// Dynamic lights, binned into clusters by LightClusters
+uniform usamplerBuffer ClusterGrid;
+uniform usamplerBuffer ClusterLights;
+uniform samplerBuffer LightData;
+uniform vec2 ClusterOrigin;
+uniform vec2 ClusterScale;
+uniform vec2 ClusterDepth;
+uniform ivec3 ClusterCount;
+
+// Sum of the lights in this fragment's cluster, so only the ones that can
+// reach it are looked at
+vec3 dynamicLights(vec3 normal, vec3 albedo)
+{
+	ivec2 tile = clamp(ivec2((gl_FragCoord.xy - ClusterOrigin) * ClusterScale), ivec2(0), ClusterCount.xy - 1);
+	int slice = clamp(int(log(max(viewDepth, 1e-4)) * ClusterDepth.x + ClusterDepth.y), 0, ClusterCount.z - 1);
+	uvec2 range = texelFetch(ClusterGrid, (slice * ClusterCount.y + tile.y) * ClusterCount.x + tile.x).xy;
+	vec3 sum = vec3(0.0);
+	for (uint i = 0u; i < range.y; i++) {
+		int light = int(texelFetch(ClusterLights, int(range.x + i)).x);
+		vec4 posRadius = texelFetch(LightData, 2*light);
+		vec3 toLight = posRadius.xyz - EPos;
+		float d = length(toLight);
+		float falloff = max(0.0, 1.0 - d/posRadius.w);
+		float nlDot = max(0.0, dot(normal, toLight/max(d, 1e-4)));
+		sum += texelFetch(LightData, 2*light + 1).rgb * albedo * nlDot * falloff*falloff;
+	}
+	return sum;
+}
+#endif
+
+void main()
+{
+#ifdef TEXTURED
+	vec4 texColor0 = texture(Texture0, vTexCoord);
+#endif
+
+#if LIGHTS == 0
+	color = texColor0;
+#else
+	vec3 normal = normalize(fragNor);
+	// each light on its own, the brightest wins
+	color = vec4(0.0);
+	for (int i = 0; i < LIGHTS; i++) {
+		vec3 light = normalize(lightDir[i]);
+		vec3 H = normalize(light + camPos - EPos);
+		float nlDot = max(0, dot(normal, light));
+		float nhDot = max(0, dot(normal, H));
+#ifdef TEXTURED
+		vec4 lit = texColor0/6.0 + texColor0*nlDot + texColor0/10.0*pow(nhDot, 4);
+#else
+		vec4 lit = vec4(MatAmb*3 + MatDif*nlDot + MatSpec*pow(nhDot, MatShine), 1.0);
+#endif
+		color = max(color, lit);
+	}
+#ifdef TEXTURED
+	color.rgb += dynamicLights(normal, texColor0.rgb);
+#else
+	color.rgb += dynamicLights(normal, MatDif);
+#endif
+#endif
+}
@@ -0,0 +1,38 @@
+#version 330 core
+// Compiled per variant with LIGHTS (point lights, 0 for unlit) and TEXTURED
+// defined, see ShaderVariants
+layout(location = 0) in vec4 vertPos;
+layout(location = 1) in vec3 vertNor;
+#ifdef TEXTURED
+layout(location = 2) in vec2 vertTex;
+out vec2 vTexCoord;
+#endif
+uniform mat4 P;
+uniform mat4 V;
+uniform mat4 M;
+
+#if LIGHTS > 0
+uniform vec3 lightPos[LIGHTS];
+out vec3 lightDir[LIGHTS];
+// distance along the view direction, picks the light cluster
+out float viewDepth;
+#endif
+out vec3 fragNor;
+out vec3 EPos;
+
+void main()
+{
+	vec4 worldPos = M * vec4(vertPos.xyz, 1.0);
+	gl_Position = P * V * worldPos;
+	fragNor = (M * vec4(vertNor, 0.0)).xyz;
+	EPos = worldPos.xyz;
+#ifdef TEXTURED
+	vTexCoord = vertTex;
+#endif
+#if LIGHTS > 0
+	for (int i = 0; i < LIGHTS; i++) {
+		lightDir[i] = lightPos[i] - worldPos.xyz;
+	}
+	viewDepth = -(V * worldPos).z;
+#endif
+}
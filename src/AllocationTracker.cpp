@@ -0,0 +1,106 @@
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+std::atomic<uint64_t> allocations(0);
+std::atomic<uint64_t> bytes(0);
+std::atomic<AllocationTracker::Hook> hook(nullptr);
+AllocationTracker::Counts frameStart;
+
+void *allocate(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	bytes.fetch_add(size, std::memory_order_relaxed);
+	AllocationTracker::Hook h = hook.load(std::memory_order_relaxed);
+	if (h)
+	{
+		h(size);
+	}
+	return std::malloc(size ? size : 1);
+}
+
+}
+
+namespace AllocationTracker
+{
+
+Counts total()
+{
+	Counts c;
+	c.allocations = allocations.load(std::memory_order_relaxed);
+	c.bytes = bytes.load(std::memory_order_relaxed);
+	return c;
+}
+
+void beginFrame()
+{
+	frameStart = total();
+}
+
+Counts endFrame()
+{
+	Counts c = total();
+	c.allocations -= frameStart.allocations;
+	c.bytes -= frameStart.bytes;
+	return c;
+}
+
+void setHook(Hook h)
+{
+	hook.store(h);
+}
+
+}
+
+// Replacements for the global allocation functions, every new in the
+// program goes through them
+
+void *operator new(size_t size)
+{
+	void *p = allocate(size);
+	if (!p)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
@@ -0,0 +1,38 @@
+//
+// Counts heap allocations made through operator new, to see what a frame
+// allocates and keep the frame loop free of it.
+//
+
+#pragma once
+#ifndef LAB471_ALLOCATIONTRACKER_H_INCLUDED
+#define LAB471_ALLOCATIONTRACKER_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+
+
+namespace AllocationTracker
+{
+	struct Counts
+	{
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+	};
+
+	// Everything since the program started, on all threads. Memory that C
+	// libraries get from malloc directly isn't seen.
+	Counts total();
+
+	// Counts of the current frame: beginFrame() starts one, endFrame()
+	// returns what was allocated since
+	void beginFrame();
+	Counts endFrame();
+
+	// Called with the size of every allocation while set, e.g. to break in
+	// a debugger on the first allocation of a frame that should have none.
+	// The hook itself must not allocate.
+	typedef void (*Hook)(size_t bytes);
+	void setHook(Hook hook);
+}
+
+#endif // LAB471_ALLOCATIONTRACKER_H_INCLUDED
@@ -0,0 +1,239 @@
+#include "AssetLoader.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#include "Texture.h"
+#include "stb_image.h"
+
+using namespace std;
+
+AssetLoader::AssetLoader(int count)
+{
+	stbi_set_flip_vertically_on_load(false);
+	for (int i = 0; i < count; i++)
+	{
+		threads.push_back(thread(&AssetLoader::work, this));
+	}
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		lock_guard<mutex> lock(sync);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+	// decoded but never uploaded
+	for (size_t j = 0; j < ready.size(); j++)
+	{
+		for (size_t i = 0; i < ready[j].images.size(); i++)
+		{
+			stbi_image_free(ready[j].images[i].pixels);
+		}
+	}
+}
+
+shared_ptr<Texture> AssetLoader::placeholder(unsigned char r, unsigned char g, unsigned char b)
+{
+	const unsigned char pixel[3] = { r, g, b };
+	shared_ptr<Texture> t = make_shared<Texture>();
+	t->upload(pixel, 1, 1, 3);
+	return t;
+}
+
+void AssetLoader::loadTexture(const string &path, const shared_ptr<Texture> &texture)
+{
+	Job job;
+	job.images.resize(1);
+	job.images[0].path = path;
+	job.texture = texture;
+	{
+		lock_guard<mutex> lock(sync);
+		queued.push_back(std::move(job));
+		outstanding++;
+	}
+	wake.notify_one();
+}
+
+void AssetLoader::loadCubeMap(const vector<string> &paths, GLuint texture)
+{
+	Job job;
+	job.images.resize(paths.size());
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		job.images[i].path = paths[i];
+	}
+	job.flip = false;
+	job.cubeMap = texture;
+	{
+		lock_guard<mutex> lock(sync);
+		queued.push_back(std::move(job));
+		outstanding++;
+	}
+	wake.notify_one();
+}
+
+future<void> AssetLoader::run(const function<void()> &work)
+{
+	Job job;
+	job.work = work;
+	job.done = make_shared<promise<void> >();
+	future<void> f = job.done->get_future();
+	{
+		// ahead of the images, someone is usually waiting for it
+		lock_guard<mutex> lock(sync);
+		queued.push_front(std::move(job));
+	}
+	wake.notify_one();
+	return f;
+}
+
+void AssetLoader::work()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(sync);
+			wake.wait(lock, [this] { return quit || !queued.empty(); });
+			if (quit)
+			{
+				return;
+			}
+			job = std::move(queued.front());
+			queued.pop_front();
+		}
+
+		if (job.work)
+		{
+			job.work();
+			job.done->set_value();
+			continue;
+		}
+
+		decode(job);
+		{
+			lock_guard<mutex> lock(sync);
+			ready.push_back(std::move(job));
+		}
+		decoded.notify_all();
+	}
+}
+
+void AssetLoader::decode(Job &job)
+{
+	for (size_t i = 0; i < job.images.size(); i++)
+	{
+		Image &image = job.images[i];
+		image.pixels = stbi_load(image.path.c_str(), &image.width, &image.height, &image.components, 0);
+		if (!image.pixels)
+		{
+			cerr << image.path << " not found" << endl;
+			continue;
+		}
+		if (job.flip)
+		{
+			// swap rows from the outside in
+			size_t row = (size_t)image.width * image.components;
+			vector<unsigned char> tmp(row);
+			for (int y = 0; y < image.height / 2; y++)
+			{
+				unsigned char *top = image.pixels + y * row;
+				unsigned char *bottom = image.pixels + (image.height - 1 - y) * row;
+				memcpy(&tmp[0], top, row);
+				memcpy(top, bottom, row);
+				memcpy(bottom, &tmp[0], row);
+			}
+		}
+	}
+}
+
+void AssetLoader::upload(Job &job)
+{
+	if (job.texture)
+	{
+		const Image &image = job.images[0];
+		if (image.pixels)
+		{
+			job.texture->upload(image.pixels, image.width, image.height, image.components);
+		}
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_CUBE_MAP, job.cubeMap);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t i = 0; i < job.images.size(); i++)
+		{
+			const Image &image = job.images[i];
+			if (image.pixels)
+			{
+				GLenum format = image.components == 4 ? GL_RGBA : GL_RGB;
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	}
+	for (size_t i = 0; i < job.images.size(); i++)
+	{
+		stbi_image_free(job.images[i].pixels);
+	}
+}
+
+int AssetLoader::update(double budget)
+{
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	int uploaded = 0;
+	do
+	{
+		Job job;
+		{
+			lock_guard<mutex> lock(sync);
+			if (ready.empty())
+			{
+				break;
+			}
+			job = std::move(ready.front());
+			ready.pop_front();
+		}
+		upload(job);
+		uploaded++;
+		lock_guard<mutex> lock(sync);
+		outstanding--;
+	} while (chrono::duration<double>(Clock::now() - start).count() < budget);
+	return uploaded;
+}
+
+void AssetLoader::finish()
+{
+	for (;;)
+	{
+		Job job;
+		{
+			unique_lock<mutex> lock(sync);
+			decoded.wait(lock, [this] { return outstanding == 0 || !ready.empty(); });
+			if (ready.empty())
+			{
+				return;
+			}
+			job = std::move(ready.front());
+			ready.pop_front();
+		}
+		upload(job);
+		lock_guard<mutex> lock(sync);
+		outstanding--;
+	}
+}
+
+int AssetLoader::pending() const
+{
+	lock_guard<mutex> lock(sync);
+	return outstanding;
+}
@@ -0,0 +1,103 @@
+//
+// Loads assets in the background so the first frame doesn't wait for them.
+//
+
+#pragma once
+#ifndef LAB471_ASSETLOADER_H_INCLUDED
+#define LAB471_ASSETLOADER_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glad/glad.h>
+
+class Texture;
+
+
+// Reading and decoding files happens on the loader's own threads. GL calls
+// happen in update() on the thread with the context, a few per frame within
+// a time budget. Until then a texture keeps whatever it held before,
+// usually a one pixel placeholder from placeholder().
+//
+// Images are decoded with stb_image's global vertical flip off and flipped
+// by the loader, so nothing else may turn it on while loading, e.g. by
+// calling Texture::init().
+class AssetLoader
+{
+
+public:
+
+	explicit AssetLoader(int threads = 2);
+	~AssetLoader();
+
+	AssetLoader(const AssetLoader &) = delete;
+	AssetLoader &operator=(const AssetLoader &) = delete;
+
+	// A texture of one pixel of the given colour, to draw with until the
+	// real image is in
+	static std::shared_ptr<Texture> placeholder(unsigned char r, unsigned char g, unsigned char b);
+
+	// Decodes path and uploads it into texture, flipped so the first row is
+	// the bottom one like Texture::init() does
+	void loadTexture(const std::string &path, const std::shared_ptr<Texture> &texture);
+
+	// The six faces +X, -X, +Y, -Y, +Z, -Z of a cube map, not flipped
+	void loadCubeMap(const std::vector<std::string> &paths, GLuint texture);
+
+	// Any other CPU work, e.g. parsing a mesh, on a loader thread before
+	// the images still queued
+	std::future<void> run(const std::function<void()> &work);
+
+	// Uploads what the threads have decoded until budget seconds have
+	// passed, at least one image. Returns how many were uploaded.
+	int update(double budget);
+
+	// Waits for and uploads everything queued so far
+	void finish();
+
+	// Queued textures and cube maps not uploaded yet
+	int pending() const;
+
+private:
+
+	struct Image
+	{
+		std::string path;
+		unsigned char *pixels = nullptr;
+		int width = 0, height = 0, components = 0;
+	};
+
+	struct Job
+	{
+		std::vector<Image> images;
+		bool flip = true;
+		std::shared_ptr<Texture> texture;
+		GLuint cubeMap = 0;
+		std::function<void()> work;
+		std::shared_ptr<std::promise<void> > done;
+	};
+
+	void work();
+	void decode(Job &job);
+	void upload(Job &job);
+
+	std::vector<std::thread> threads;
+	mutable std::mutex sync;
+	std::condition_variable wake;
+	std::condition_variable decoded;
+	std::deque<Job> queued;
+	std::deque<Job> ready;
+	// textures and cube maps queued and not uploaded yet
+	int outstanding = 0;
+	bool quit = false;
+
+};
+
+#endif // LAB471_ASSETLOADER_H_INCLUDED
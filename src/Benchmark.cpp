@@ -0,0 +1,330 @@
+#include "Benchmark.h"
+#include "AllocationTracker.h"
+#include <iostream>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+struct Stats
+{
+	double mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+};
+
+// Nearest-rank percentile of already sorted samples
+double percentile(const vector<double> &sorted, double p)
+{
+	if (sorted.empty())
+	{
+		return 0.0;
+	}
+	size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+Stats stats(vector<double> samples)
+{
+	Stats s;
+	if (samples.empty())
+	{
+		return s;
+	}
+	sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		sum += samples[i];
+	}
+	s.mean = sum / samples.size();
+	s.p50 = percentile(samples, 50);
+	s.p95 = percentile(samples, 95);
+	s.p99 = percentile(samples, 99);
+	s.max = samples.back();
+	return s;
+}
+
+void writeStats(ostream &out, const Stats &s)
+{
+	out << "{\"mean\": " << s.mean << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95
+		<< ", \"p99\": " << s.p99 << ", \"max\": " << s.max << "}";
+}
+
+string jsonEscape(const string &in)
+{
+	string out;
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		char c = in[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			out += ' ';
+		}
+		else
+		{
+			out += c;
+		}
+	}
+	return out;
+}
+
+vec3 catmullRom(const vec3 &p0, const vec3 &p1, const vec3 &p2, const vec3 &p3, float u)
+{
+	float u2 = u * u;
+	float u3 = u2 * u;
+	return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+}
+
+}
+
+bool Scenario::load(const string &path)
+{
+	ifstream in(path);
+	if (!in.is_open())
+	{
+		cerr << "Could not open scenario '" << path << "'" << endl;
+		return false;
+	}
+	string line;
+	int lineNo = 0;
+	while (getline(in, line))
+	{
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != string::npos)
+		{
+			line.erase(hash);
+		}
+		istringstream words(line);
+		string directive;
+		if (!(words >> directive))
+		{
+			continue;
+		}
+		bool ok = true;
+		if (directive == "name")
+		{
+			ok = (bool)(words >> name);
+		}
+		else if (directive == "frames")
+		{
+			ok = (bool)(words >> frames) && frames > 0;
+		}
+		else if (directive == "warmup")
+		{
+			ok = (bool)(words >> warmup) && warmup >= 0;
+		}
+		else if (directive == "scale")
+		{
+			ok = (bool)(words >> scale) && scale > 0;
+		}
+		else if (directive == "seed")
+		{
+			ok = (bool)(words >> seed);
+			hasSeed = true;
+		}
+		else if (directive == "camera")
+		{
+			CameraKey k;
+			ok = (bool)(words >> k.time >> k.eye.x >> k.eye.y >> k.eye.z >> k.target.x >> k.target.y >> k.target.z);
+			if (ok && !camera.empty() && k.time <= camera.back().time)
+			{
+				cerr << path << ":" << lineNo << ": camera keys must have increasing times" << endl;
+				return false;
+			}
+			camera.push_back(k);
+		}
+		else if (directive == "event")
+		{
+			Event e;
+			string type;
+			ok = (bool)(words >> e.time >> type);
+			e.count = 1;
+			if (ok && type == "rocket")
+			{
+				e.type = Event::ROCKET;
+			}
+			else if (ok && type == "explode")
+			{
+				e.type = Event::EXPLODE;
+				ok = (bool)(words >> e.count);
+			}
+			else
+			{
+				ok = false;
+			}
+			events.push_back(e);
+		}
+		else
+		{
+			ok = false;
+		}
+		if (!ok)
+		{
+			cerr << path << ":" << lineNo << ": could not parse '" << line << "'" << endl;
+			return false;
+		}
+	}
+	if (camera.empty())
+	{
+		cerr << path << ": a scenario needs at least one camera key" << endl;
+		return false;
+	}
+	return true;
+}
+
+void Scenario::cameraAt(uint32_t step, vec3 &eye, vec3 &target) const
+{
+	float t = step / (float)StepsPerSecond;
+	size_t n = camera.size();
+	if (n == 1 || t <= camera[0].time)
+	{
+		eye = camera[0].eye;
+		target = camera[0].target;
+		return;
+	}
+	if (t >= camera[n - 1].time)
+	{
+		eye = camera[n - 1].eye;
+		target = camera[n - 1].target;
+		return;
+	}
+	size_t k = 0;
+	while (k + 1 < n && camera[k + 1].time <= t)
+	{
+		k++;
+	}
+	const CameraKey &k0 = camera[k == 0 ? 0 : k - 1];
+	const CameraKey &k1 = camera[k];
+	const CameraKey &k2 = camera[k + 1];
+	const CameraKey &k3 = camera[std::min(k + 2, n - 1)];
+	float u = (t - k1.time) / (k2.time - k1.time);
+	eye = catmullRom(k0.eye, k1.eye, k2.eye, k3.eye, u);
+	target = catmullRom(k0.target, k1.target, k2.target, k3.target, u);
+}
+
+vector<Scenario::Event> Scenario::eventsAt(uint32_t step) const
+{
+	vector<Event> fired;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		if ((uint32_t)lround(events[i].time * StepsPerSecond) == step)
+		{
+			fired.push_back(events[i]);
+		}
+	}
+	return fired;
+}
+
+const char *Benchmark::phaseName(Phase p)
+{
+	switch (p)
+	{
+		case UPDATE: return "update";
+		case PORTAL: return "portal";
+		case PORTAL_COMPOSITE: return "portal_composite";
+		case SKYBOX: return "skybox";
+		case SCENE: return "scene";
+		case SUN: return "sun";
+		case PARTICLES: return "particles";
+		case BLOOM: return "bloom";
+		case SWAP: return "swap";
+		default: return "unknown";
+	}
+}
+
+Benchmark::Benchmark(const Scenario &scenario) :
+	scenario(scenario)
+{
+	frameMs.reserve(scenario.frames);
+	allocations.reserve(scenario.frames);
+	allocatedBytes.reserve(scenario.frames);
+	for (int p = 0; p < NUM_PHASES; p++)
+	{
+		current[p] = 0.0;
+		phaseMs[p].reserve(scenario.frames);
+	}
+}
+
+void Benchmark::beginFrame()
+{
+	frameStart = lastMark = Clock::now();
+	for (int p = 0; p < NUM_PHASES; p++)
+	{
+		current[p] = 0.0;
+	}
+}
+
+void Benchmark::mark(Phase p)
+{
+	Clock::time_point now = Clock::now();
+	current[p] += chrono::duration<double, milli>(now - lastMark).count();
+	lastMark = now;
+}
+
+void Benchmark::endFrame()
+{
+	double ms = chrono::duration<double, milli>(Clock::now() - frameStart).count();
+	if (frameIndex >= scenario.warmup)
+	{
+		frameMs.push_back(ms);
+		for (int p = 0; p < NUM_PHASES; p++)
+		{
+			phaseMs[p].push_back(current[p]);
+		}
+		// since beginFrame() of the main loop
+		AllocationTracker::Counts allocated = AllocationTracker::endFrame();
+		allocations.push_back((double)allocated.allocations);
+		allocatedBytes.push_back((double)allocated.bytes);
+	}
+	frameIndex++;
+}
+
+bool Benchmark::writeReport(const string &path, uint64_t seed, const string &renderer) const
+{
+	Stats frame = stats(frameMs);
+	printf("benchmark %s: %d frames, frame time ms p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+		scenario.name.c_str(), (int)frameMs.size(), frame.p50, frame.p95, frame.p99, frame.max);
+	Stats allocs = stats(allocations);
+	printf("  allocations per frame mean %.1f  max %.0f, bytes per frame mean %.0f\n", allocs.mean, allocs.max, stats(allocatedBytes).mean);
+
+	ofstream out(path);
+	if (!out.is_open())
+	{
+		cerr << "Could not write benchmark report '" << path << "'" << endl;
+		return false;
+	}
+	out << "{\n";
+	out << "  \"scenario\": \"" << jsonEscape(scenario.name) << "\",\n";
+	out << "  \"frames\": " << frameMs.size() << ",\n";
+	out << "  \"warmup\": " << scenario.warmup << ",\n";
+	out << "  \"scale\": " << scenario.scale << ",\n";
+	out << "  \"seed\": " << seed << ",\n";
+	out << "  \"renderer\": \"" << jsonEscape(renderer) << "\",\n";
+	out << "  \"frame_ms\": ";
+	writeStats(out, frame);
+	out << ",\n  \"phases_ms\": {\n";
+	for (int p = 0; p < NUM_PHASES; p++)
+	{
+		out << "    \"" << phaseName((Phase)p) << "\": ";
+		writeStats(out, stats(phaseMs[p]));
+		out << (p + 1 < NUM_PHASES ? ",\n" : "\n");
+	}
+	out << "  },\n  \"allocations_per_frame\": ";
+	writeStats(out, allocs);
+	out << ",\n  \"allocated_bytes_per_frame\": ";
+	writeStats(out, stats(allocatedBytes));
+	out << "\n}\n";
+	return true;
+}
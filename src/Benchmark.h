@@ -0,0 +1,116 @@
+//
+// Scripted benchmark scenarios.
+//
+// A scenario file is plain text, one directive per line, '#' starts a comment:
+//
+//   name <id>                    identifier used in the report
+//   frames <n>                   frames to measure
+//   warmup <n>                   frames to run before measuring (default 60)
+//   scale <s>                    scene scale, multiplies planet/asteroid counts
+//   seed <n>                     world seed (default: the --seed value)
+//   camera <t> <x y z> <x y z>   spline key: time (s), eye, look target
+//   event <t> rocket             fire a rocket from the ship
+//   event <t> explode <n>        blow up n planets at once
+//
+// Times are in simulation seconds, the sim runs a fixed 60 steps per second.
+// The camera follows a Catmull-Rom spline through the keys.
+//
+
+#pragma once
+#ifndef LAB471_BENCHMARK_H_INCLUDED
+#define LAB471_BENCHMARK_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+
+struct Scenario
+{
+	struct CameraKey
+	{
+		float time;
+		glm::vec3 eye;
+		glm::vec3 target;
+	};
+
+	struct Event
+	{
+		enum Type { ROCKET, EXPLODE };
+
+		float time;
+		Type type;
+		int count;
+	};
+
+	static const int StepsPerSecond = 60;
+
+	bool load(const std::string &path);
+
+	// Camera at the given simulation step
+	void cameraAt(uint32_t step, glm::vec3 &eye, glm::vec3 &target) const;
+
+	// Events that fire on the given simulation step
+	std::vector<Event> eventsAt(uint32_t step) const;
+
+	std::string name = "unnamed";
+	int frames = 1000;
+	int warmup = 60;
+	float scale = 1.0f;
+	bool hasSeed = false;
+	uint64_t seed = 0;
+	std::vector<CameraKey> camera;
+	std::vector<Event> events;
+};
+
+class Benchmark
+{
+
+public:
+
+	// CPU phases of a frame, in the order they run
+	enum Phase { UPDATE, PORTAL, PORTAL_COMPOSITE, SKYBOX, SCENE, SUN, PARTICLES, BLOOM, SWAP, NUM_PHASES };
+
+	static const char *phaseName(Phase p);
+
+	explicit Benchmark(const Scenario &scenario);
+
+	const Scenario &getScenario() const { return scenario; }
+
+	// Frame boundaries. The time between beginFrame() and the first mark()
+	// is not attributed to any phase.
+	void beginFrame();
+	void endFrame();
+
+	// Attributes the time since the previous mark (or beginFrame) to phase p
+	void mark(Phase p);
+
+	// Number of frames run so far, warmup included
+	int frame() const { return frameIndex; }
+	bool done() const { return frameIndex >= scenario.warmup + scenario.frames; }
+
+	// Writes the report as JSON; also prints a summary to stdout
+	bool writeReport(const std::string &path, uint64_t seed, const std::string &renderer) const;
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	const Scenario &scenario;
+	int frameIndex = 0;
+	Clock::time_point frameStart;
+	Clock::time_point lastMark;
+	double current[NUM_PHASES];
+
+	std::vector<double> frameMs;
+	std::vector<double> phaseMs[NUM_PHASES];
+	// heap allocations per frame, see AllocationTracker
+	std::vector<double> allocations;
+	std::vector<double> allocatedBytes;
+
+};
+
+#endif // LAB471_BENCHMARK_H_INCLUDED
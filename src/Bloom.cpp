@@ -0,0 +1,150 @@
+#include "Bloom.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+Bloom::~Bloom()
+{
+	if (quadVAO)
+	{
+		glDeleteVertexArrays(1, &quadVAO);
+		glDeleteBuffers(1, &quadVBO);
+	}
+}
+
+shared_ptr<Program> Bloom::makeProgram(const string &resourceDirectory, const string &frag)
+{
+	shared_ptr<Program> prog = make_shared<Program>();
+	prog->setVerbose(true);
+	prog->setShaderNames(resourceDirectory + "/blur_vert.glsl", resourceDirectory + "/" + frag);
+	prog->init();
+	prog->addUniform("screenTexture");
+	prog->addAttribute("aPos");
+	prog->addAttribute("aTexCoords");
+	return prog;
+}
+
+void Bloom::init(const string &resourceDirectory)
+{
+	thresholdProg = makeProgram(resourceDirectory, "bloom_threshold_frag.glsl");
+	thresholdProg->addUniform("texelSize");
+	thresholdProg->addUniform("curve");
+	downProg = makeProgram(resourceDirectory, "bloom_down_frag.glsl");
+	downProg->addUniform("texelSize");
+	upProg = makeProgram(resourceDirectory, "bloom_up_frag.glsl");
+	upProg->addUniform("texelSize");
+	compositeProg = makeProgram(resourceDirectory, "bloom_frag.glsl");
+	compositeProg->addUniform("intensity");
+
+	// fullscreen triangle strip: position, texture coordinates
+	float quad[] = {
+		-1.0f, -1.0f, 0.0f, 0.0f,
+		 1.0f, -1.0f, 1.0f, 0.0f,
+		-1.0f,  1.0f, 0.0f, 1.0f,
+		 1.0f,  1.0f, 1.0f, 1.0f,
+	};
+	glGenVertexArrays(1, &quadVAO);
+	glGenBuffers(1, &quadVBO);
+	glBindVertexArray(quadVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Bloom::drawQuad()
+{
+	glBindVertexArray(quadVAO);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+}
+
+void Bloom::draw(shared_ptr<Program> prog, const RenderTarget &src)
+{
+	prog->bind();
+	glUniform1i(prog->getUniform("screenTexture"), 0);
+	glUniform2f(prog->getUniform("texelSize"), 1.0f / src.width, 1.0f / src.height);
+	glBindTexture(GL_TEXTURE_2D, src.color);
+	drawQuad();
+	prog->unbind();
+}
+
+void Bloom::addPasses(FrameGraph &graph, FrameGraph::Resource frame, int width, int height)
+{
+	if (!enabled || levels < 1 || width < 2 || height < 2)
+	{
+		return;
+	}
+
+	// the frame at half size; bilinear blit filtering averages 2x2
+	int w = width / 2;
+	int h = height / 2;
+	FrameGraph::Resource half = graph.create("bloomFrame", RenderTargetDesc(w, h, GL_RGB8, GL_NONE));
+	chain.clear();
+	for (int i = 0; i < levels && w >= 1 && h >= 1; i++)
+	{
+		chain.push_back(graph.create("bloomLevel", RenderTargetDesc(w, h, GL_R11F_G11F_B10F, GL_NONE)));
+		w /= 2;
+		h /= 2;
+	}
+
+	graph.addPass("bloomDownscale", [&graph, frame, half]()
+	{
+		PROFILE_GPU_SCOPE("bloom");
+		RenderTarget *src = graph.target(frame);
+		RenderTarget *dst = graph.target(half);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, src ? src->fbo : 0);
+		glBlitFramebuffer(0, 0, graph.width(frame), graph.height(frame), 0, 0, dst->width, dst->height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		// back to what the state cache thinks is bound
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, dst->fbo);
+	}).read(frame).write(half).state(PassState::fullscreen());
+
+	graph.addPass("bloomThreshold", [this, &graph, half]()
+	{
+		PROFILE_GPU_SCOPE("bloom");
+		float k = std::max(knee, 0.0001f);
+		thresholdProg->bind();
+		glUniform4f(thresholdProg->getUniform("curve"), threshold, k, 2 * k, .25f / k);
+		draw(thresholdProg, *graph.target(half));
+	}).read(half).write(chain[0]).state(PassState::fullscreen());
+
+	for (size_t i = 1; i < chain.size(); i++)
+	{
+		FrameGraph::Resource src = chain[i - 1];
+		graph.addPass("bloomDown", [this, &graph, src]()
+		{
+			PROFILE_GPU_SCOPE("bloom");
+			draw(downProg, *graph.target(src));
+		}).read(src).write(chain[i]).state(PassState::fullscreen());
+	}
+
+	// each level adds the blurred level below it
+	for (size_t i = chain.size() - 1; i > 0; i--)
+	{
+		FrameGraph::Resource src = chain[i];
+		graph.addPass("bloomUp", [this, &graph, src]()
+		{
+			PROFILE_GPU_SCOPE("bloom");
+			draw(upProg, *graph.target(src));
+		}).read(src).write(chain[i - 1]).state(PassState::additive());
+	}
+
+	FrameGraph::Resource result = chain[0];
+	float strength = intensity / chain.size();
+	graph.addPass("bloomComposite", [this, &graph, result, strength]()
+	{
+		PROFILE_GPU_SCOPE("bloom");
+		compositeProg->bind();
+		glUniform1i(compositeProg->getUniform("screenTexture"), 0);
+		glUniform1f(compositeProg->getUniform("intensity"), strength);
+		glBindTexture(GL_TEXTURE_2D, graph.target(result)->color);
+		drawQuad();
+		compositeProg->unbind();
+	}).read(result).write(frame).state(PassState::additive());
+}
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef LAB471_BLOOM_H_INCLUDED
+#define LAB471_BLOOM_H_INCLUDED
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Program.h"
+#include "FrameGraph.h"
+
+
+// Glow around the bright parts of the frame.
+//
+// The finished frame is downscaled to half size, bright pixels are kept
+// with a soft threshold, and the result is blurred by a dual Kawase chain
+// down to 1/2^levels of the frame size and back up again, each level adding
+// the wider blur of the level below it. The half size result is added on
+// top of the frame. Every pass runs at half size or less and reads 4-8
+// bilinear taps, so the glow is wide for a fraction of a full resolution
+// kernel of the same radius. Each step is a frame graph pass and the
+// intermediate images are transient resources.
+class Bloom
+{
+
+public:
+
+	// Pixels brighter than threshold (max of r, g, b) glow, with a soft ramp
+	// `knee` wide around it
+	float threshold = .8f;
+	float knee = .3f;
+	float intensity = .8f;
+	int levels = 3;
+	bool enabled = true;
+
+	~Bloom();
+
+	void init(const std::string &resourceDirectory);
+
+	// Adds the passes that put bloom on top of `frame`. Intermediate images
+	// are sized from width x height, the size offscreen targets use.
+	void addPasses(FrameGraph &graph, FrameGraph::Resource frame, int width, int height);
+
+private:
+
+	std::shared_ptr<Program> makeProgram(const std::string &resourceDirectory, const std::string &frag);
+	void drawQuad();
+	void draw(std::shared_ptr<Program> prog, const RenderTarget &src);
+
+	std::shared_ptr<Program> thresholdProg;
+	std::shared_ptr<Program> downProg;
+	std::shared_ptr<Program> upProg;
+	std::shared_ptr<Program> compositeProg;
+	GLuint quadVAO = 0;
+	GLuint quadVBO = 0;
+	// this frame's levels, kept to reuse the storage
+	std::vector<FrameGraph::Resource> chain;
+
+};
+
+#endif // LAB471_BLOOM_H_INCLUDED
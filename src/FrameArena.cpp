@@ -0,0 +1,72 @@
+#include "FrameArena.h"
+
+#include <cstdint>
+
+using namespace std;
+
+namespace
+{
+
+size_t alignUp(size_t n, size_t alignment)
+{
+	return (n + alignment - 1) & ~(alignment - 1);
+}
+
+}
+
+FrameArena::FrameArena(size_t capacity) :
+	block(static_cast<char *>(::operator new(capacity))),
+	size(capacity)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	::operator delete(block);
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	// the block comes from operator new, so it is aligned for anything
+	size_t start = alignUp(offset, alignment);
+	if (start + bytes <= size)
+	{
+		offset = start + bytes;
+		return block + start;
+	}
+	size_t padded = bytes + alignment;
+	char *memory = static_cast<char *>(::operator new(padded));
+	overflow.push_back(memory);
+	overflowBytes += padded;
+	return memory + (alignUp((uintptr_t)memory, alignment) - (uintptr_t)memory);
+}
+
+void FrameArena::reset()
+{
+	for (Cleanup *c = cleanups; c; c = c->next)
+	{
+		c->destroy(c->object);
+	}
+	cleanups = nullptr;
+
+	if (!overflow.empty())
+	{
+		for (size_t i = 0; i < overflow.size(); i++)
+		{
+			::operator delete(overflow[i]);
+		}
+		overflow.clear();
+		// room for the whole of this frame, and then some
+		size_t needed = offset + overflowBytes;
+		while (size < needed)
+		{
+			size *= 2;
+		}
+		size *= 2;
+		::operator delete(block);
+		block = static_cast<char *>(::operator new(size));
+	}
+	offset = 0;
+	overflowBytes = 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef LAB471_FRAMEARENA_H_INCLUDED
+#define LAB471_FRAMEARENA_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+
+// Linear allocator for data that only lives for one frame. Allocating bumps
+// a pointer into one block, reset() drops everything at once.
+//
+// What doesn't fit into the block is allocated from the heap for the rest of
+// the frame. reset() then replaces the block with one big enough for that
+// frame, so once frames stop growing the arena stops allocating.
+class FrameArena
+{
+
+public:
+
+	explicit FrameArena(size_t capacity = 64 * 1024);
+	~FrameArena();
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// Constructs a T in the arena. Its destructor runs on reset().
+	template<class T, class... Args>
+	T *make(Args&&... args)
+	{
+		T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			Cleanup *c = new (allocate(sizeof(Cleanup), alignof(Cleanup))) Cleanup;
+			c->destroy = &destroy<T>;
+			c->object = object;
+			c->next = cleanups;
+			cleanups = c;
+		}
+		return object;
+	}
+
+	// Destroys what make() constructed, newest first, and frees everything
+	void reset();
+
+	// Bytes handed out since the last reset()
+	size_t used() const { return offset + overflowBytes; }
+	size_t capacity() const { return size; }
+
+private:
+
+	struct Cleanup
+	{
+		void (*destroy)(void *);
+		void *object;
+		Cleanup *next;
+	};
+
+	template<class T>
+	static void destroy(void *object) { static_cast<T *>(object)->~T(); }
+
+	char *block;
+	size_t size;
+	size_t offset = 0;
+	std::vector<void *> overflow;
+	size_t overflowBytes = 0;
+	Cleanup *cleanups = nullptr;
+
+};
+
+// Standard allocator on a FrameArena. Deallocation does nothing, the memory
+// comes back with the arena's reset(), so containers using it must be gone
+// by then.
+template<class T>
+struct FrameAllocator
+{
+	typedef T value_type;
+
+	explicit FrameAllocator(FrameArena &arena) : arena(&arena) {}
+	template<class U>
+	FrameAllocator(const FrameAllocator<U> &o) : arena(o.arena) {}
+
+	T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T *, size_t) {}
+
+	template<class U>
+	bool operator==(const FrameAllocator<U> &o) const { return arena == o.arena; }
+	template<class U>
+	bool operator!=(const FrameAllocator<U> &o) const { return arena != o.arena; }
+
+	FrameArena *arena;
+};
+
+template<class T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+#endif // LAB471_FRAMEARENA_H_INCLUDED
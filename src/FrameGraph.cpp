@@ -0,0 +1,447 @@
+#include "FrameGraph.h"
+#include "Profiler.h"
+#include <algorithm>
+
+using namespace std;
+
+PassState PassState::opaque()
+{
+	return PassState();
+}
+
+PassState PassState::skybox()
+{
+	PassState s;
+	s.depthFunc = GL_LEQUAL;
+	return s;
+}
+
+PassState PassState::alphaBlend()
+{
+	PassState s;
+	s.blend = true;
+	return s;
+}
+
+PassState PassState::fullscreen()
+{
+	PassState s;
+	s.depthTest = false;
+	s.depthWrite = false;
+	return s;
+}
+
+PassState PassState::additive()
+{
+	PassState s = fullscreen();
+	s.blend = true;
+	s.blendSrc = GL_ONE;
+	s.blendDst = GL_ONE;
+	return s;
+}
+
+void GLStateCache::enable(GLenum cap, bool on, bool &cur)
+{
+	if (known && cur == on)
+	{
+		numSkipped++;
+		return;
+	}
+	if (on)
+	{
+		glEnable(cap);
+	}
+	else
+	{
+		glDisable(cap);
+	}
+	cur = on;
+	numIssued++;
+}
+
+void GLStateCache::depthMask(bool write)
+{
+	if (known && current.depthWrite == write)
+	{
+		numSkipped++;
+		return;
+	}
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	current.depthWrite = write;
+	numIssued++;
+}
+
+void GLStateCache::apply(const PassState &s)
+{
+	enable(GL_DEPTH_TEST, s.depthTest, current.depthTest);
+	depthMask(s.depthWrite);
+	if (!known || current.depthFunc != s.depthFunc)
+	{
+		glDepthFunc(s.depthFunc);
+		current.depthFunc = s.depthFunc;
+		numIssued++;
+	}
+	else
+	{
+		numSkipped++;
+	}
+	enable(GL_BLEND, s.blend, current.blend);
+	if (!known || current.blendSrc != s.blendSrc || current.blendDst != s.blendDst)
+	{
+		glBlendFunc(s.blendSrc, s.blendDst);
+		current.blendSrc = s.blendSrc;
+		current.blendDst = s.blendDst;
+		numIssued++;
+	}
+	else
+	{
+		numSkipped++;
+	}
+	known = true;
+}
+
+void GLStateCache::bindFramebuffer(GLuint target)
+{
+	if (fboKnown && fbo == target)
+	{
+		numSkipped++;
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, target);
+	fbo = target;
+	fboKnown = true;
+	numIssued++;
+}
+
+void GLStateCache::viewport(int x, int y, int width, int height)
+{
+	if (viewKnown && view[0] == x && view[1] == y && view[2] == width && view[3] == height)
+	{
+		numSkipped++;
+		return;
+	}
+	glViewport(x, y, width, height);
+	view[0] = x;
+	view[1] = y;
+	view[2] = width;
+	view[3] = height;
+	viewKnown = true;
+	numIssued++;
+}
+
+void GLStateCache::stencilTest(bool on)
+{
+	if (stencilKnown && stencil == on)
+	{
+		numSkipped++;
+		return;
+	}
+	if (on)
+	{
+		glEnable(GL_STENCIL_TEST);
+	}
+	else
+	{
+		glDisable(GL_STENCIL_TEST);
+	}
+	stencil = on;
+	stencilKnown = true;
+	numIssued++;
+}
+
+void GLStateCache::colorMask(bool write)
+{
+	if (colorKnown && colorWrite == write)
+	{
+		numSkipped++;
+		return;
+	}
+	GLboolean w = write ? GL_TRUE : GL_FALSE;
+	glColorMask(w, w, w, w);
+	colorWrite = write;
+	colorKnown = true;
+	numIssued++;
+}
+
+void GLStateCache::invalidate()
+{
+	known = fboKnown = viewKnown = stencilKnown = colorKnown = false;
+}
+
+FrameGraph::Pass &FrameGraph::Pass::clear(float r, float g, float b, float a, bool depth)
+{
+	clearColor = true;
+	clearDepth = depth;
+	clearValue[0] = r;
+	clearValue[1] = g;
+	clearValue[2] = b;
+	clearValue[3] = a;
+	return *this;
+}
+
+void FrameGraph::reset()
+{
+	for (size_t i = 0; i < passes.size(); i++)
+	{
+		passes[i].reads.clear();
+		passes[i].writes.clear();
+		spareLists.push_back(std::move(passes[i].reads));
+		spareLists.push_back(std::move(passes[i].writes));
+	}
+	resources.clear();
+	passes.clear();
+	order.clear();
+}
+
+FrameGraph::Resource FrameGraph::add(const ResourceNode &node)
+{
+	resources.push_back(node);
+	return (Resource)resources.size() - 1;
+}
+
+FrameGraph::Resource FrameGraph::backbuffer(int width, int height)
+{
+	ResourceNode node;
+	node.name = "backbuffer";
+	node.kind = BACKBUFFER;
+	node.desc = RenderTargetDesc(width, height);
+	node.output = true;
+	return add(node);
+}
+
+FrameGraph::Resource FrameGraph::create(const char *name, const RenderTargetDesc &desc)
+{
+	ResourceNode node;
+	node.name = name;
+	node.kind = TRANSIENT;
+	node.desc = desc;
+	return add(node);
+}
+
+FrameGraph::Resource FrameGraph::import(const char *name, RenderTarget &target, bool output)
+{
+	ResourceNode node;
+	node.name = name;
+	node.kind = IMPORTED;
+	node.desc = target.desc;
+	node.target = &target;
+	node.output = output;
+	return add(node);
+}
+
+FrameGraph::Resource FrameGraph::dependency(const char *name)
+{
+	ResourceNode node;
+	node.name = name;
+	node.kind = DEPENDENCY;
+	return add(node);
+}
+
+FrameGraph::Pass &FrameGraph::addPass(const char *name)
+{
+	passes.push_back(Pass());
+	Pass &p = passes.back();
+	p.name = name;
+	if (spareLists.size() >= 2)
+	{
+		p.writes.swap(spareLists.back());
+		spareLists.pop_back();
+		p.reads.swap(spareLists.back());
+		spareLists.pop_back();
+	}
+	return p;
+}
+
+int FrameGraph::width(Resource r) const
+{
+	return resources[r].target ? resources[r].target->width : resources[r].desc.width;
+}
+
+int FrameGraph::height(Resource r) const
+{
+	return resources[r].target ? resources[r].target->height : resources[r].desc.height;
+}
+
+bool FrameGraph::dependsOn(int later, int earlier) const
+{
+	const Pass &a = passes[earlier];
+	const Pass &b = passes[later];
+	for (size_t i = 0; i < a.writes.size(); i++)
+	{
+		// read after write and write after write
+		if (find(b.reads.begin(), b.reads.end(), a.writes[i]) != b.reads.end() ||
+			find(b.writes.begin(), b.writes.end(), a.writes[i]) != b.writes.end())
+		{
+			return true;
+		}
+	}
+	for (size_t i = 0; i < a.reads.size(); i++)
+	{
+		// write after read
+		if (find(b.writes.begin(), b.writes.end(), a.reads[i]) != b.writes.end())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FrameGraph::compile()
+{
+	// walk back from the outputs; a pass that writes something needed is
+	// needed and so is everything it reads. Writes don't end a resource's
+	// need since passes draw on top of what earlier passes left.
+	vector<bool> needed(resources.size(), false);
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		needed[r] = resources[r].output;
+	}
+	for (int i = (int)passes.size() - 1; i >= 0; i--)
+	{
+		Pass &p = passes[i];
+		p.alive = p.sideEffects;
+		for (size_t j = 0; j < p.writes.size() && !p.alive; j++)
+		{
+			p.alive = needed[p.writes[j]];
+		}
+		if (p.alive)
+		{
+			for (size_t j = 0; j < p.reads.size(); j++)
+			{
+				needed[p.reads[j]] = true;
+			}
+		}
+	}
+
+	// list schedule: of the passes whose dependencies ran, take one drawing
+	// to the same target as the last pass, else the first declared
+	order.clear();
+	vector<bool> done(passes.size(), false);
+	Resource lastTarget = -1;
+	for (;;)
+	{
+		int pick = -1;
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			if (!passes[i].alive || done[i])
+			{
+				continue;
+			}
+			bool ready = true;
+			for (size_t j = 0; j < i && ready; j++)
+			{
+				ready = !passes[j].alive || done[j] || !dependsOn((int)i, (int)j);
+			}
+			if (!ready)
+			{
+				continue;
+			}
+			Resource target = passes[i].writes.empty() ? -1 : passes[i].writes[0];
+			if (pick < 0)
+			{
+				pick = (int)i;
+			}
+			if (target >= 0 && target == lastTarget)
+			{
+				pick = (int)i;
+				break;
+			}
+		}
+		if (pick < 0)
+		{
+			break;
+		}
+		done[pick] = true;
+		order.push_back(pick);
+		lastTarget = passes[pick].writes.empty() ? -1 : passes[pick].writes[0];
+	}
+
+	for (size_t r = 0; r < resources.size(); r++)
+	{
+		resources[r].firstUse = resources[r].lastUse = -1;
+	}
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		const Pass &p = passes[order[k]];
+		for (int rw = 0; rw < 2; rw++)
+		{
+			const vector<Resource> &list = rw ? p.writes : p.reads;
+			for (size_t j = 0; j < list.size(); j++)
+			{
+				ResourceNode &node = resources[list[j]];
+				if (node.firstUse < 0)
+				{
+					node.firstUse = (int)k;
+				}
+				node.lastUse = (int)k;
+			}
+		}
+	}
+}
+
+GLuint FrameGraph::framebuffer(const Pass &pass, int &w, int &h) const
+{
+	for (size_t i = 0; i < pass.writes.size(); i++)
+	{
+		const ResourceNode &node = resources[pass.writes[i]];
+		if (node.kind == DEPENDENCY)
+		{
+			continue;
+		}
+		w = width(pass.writes[i]);
+		h = height(pass.writes[i]);
+		return node.kind == BACKBUFFER ? 0 : node.target->fbo;
+	}
+	w = h = -1;
+	return 0;
+}
+
+void FrameGraph::execute()
+{
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		Pass &p = passes[order[k]];
+		for (size_t r = 0; r < resources.size(); r++)
+		{
+			if (resources[r].kind == TRANSIENT && resources[r].firstUse == (int)k)
+			{
+				resources[r].target = &targets.acquireTransient(resources[r].desc);
+			}
+		}
+
+		PROFILE_SCOPE(p.name);
+		if (!p.external)
+		{
+			int w, h;
+			GLuint fbo = framebuffer(p, w, h);
+			if (w >= 0)
+			{
+				cache.bindFramebuffer(fbo);
+				cache.viewport(0, 0, w, h);
+			}
+			cache.apply(p.passState);
+			if (p.clearColor || p.clearDepth)
+			{
+				// glClear respects the depth mask
+				cache.depthMask(true);
+				glClearColor(p.clearValue[0], p.clearValue[1], p.clearValue[2], p.clearValue[3]);
+				glClear((p.clearColor ? GL_COLOR_BUFFER_BIT : 0) | (p.clearDepth ? GL_DEPTH_BUFFER_BIT : 0));
+				cache.depthMask(p.passState.depthWrite);
+			}
+		}
+		p.run(p.closure);
+		if (p.external)
+		{
+			cache.invalidate();
+		}
+
+		for (size_t r = 0; r < resources.size(); r++)
+		{
+			if (resources[r].kind == TRANSIENT && resources[r].lastUse == (int)k)
+			{
+				targets.release(*resources[r].target);
+				resources[r].target = nullptr;
+			}
+		}
+	}
+}
@@ -0,0 +1,200 @@
+#pragma once
+#ifndef LAB471_FRAMEGRAPH_H_INCLUDED
+#define LAB471_FRAMEGRAPH_H_INCLUDED
+
+#include <vector>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "RenderTarget.h"
+#include "FrameArena.h"
+
+
+// Fixed function state a pass draws with
+struct PassState
+{
+	bool depthTest = true;
+	bool depthWrite = true;
+	GLenum depthFunc = GL_LESS;
+	bool blend = false;
+	GLenum blendSrc = GL_SRC_ALPHA;
+	GLenum blendDst = GL_ONE_MINUS_SRC_ALPHA;
+
+	// depth tested and written, no blending
+	static PassState opaque();
+	// opaque, but passes at the far plane too
+	static PassState skybox();
+	// depth tested, alpha blended
+	static PassState alphaBlend();
+	// no depth, no blending
+	static PassState fullscreen();
+	// no depth, added on top
+	static PassState additive();
+};
+
+// Remembers the GL state it set and skips calls that wouldn't change it.
+// Everything that sets this state during a frame has to go through the
+// cache, or call invalidate() afterwards.
+class GLStateCache
+{
+
+public:
+
+	void apply(const PassState &state);
+	void depthMask(bool write);
+	void bindFramebuffer(GLuint fbo);
+	void viewport(int x, int y, int width, int height);
+	// Not part of PassState, passes keep whatever was set around them
+	void stencilTest(bool on);
+	void colorMask(bool write);
+
+	// Forget everything, the next calls set all state again
+	void invalidate();
+
+	// Calls issued and skipped since the last resetCounters()
+	int issued() const { return numIssued; }
+	int skipped() const { return numSkipped; }
+	void resetCounters() { numIssued = numSkipped = 0; }
+
+private:
+
+	void enable(GLenum cap, bool on, bool &current);
+
+	bool known = false;
+	PassState current;
+	GLuint fbo = 0;
+	int view[4] = {0, 0, 0, 0};
+	bool fboKnown = false;
+	bool viewKnown = false;
+	bool stencil = false;
+	bool colorWrite = true;
+	bool stencilKnown = false;
+	bool colorKnown = false;
+	int numIssued = 0;
+	int numSkipped = 0;
+
+};
+
+// A frame's render passes and the targets they pass between each other.
+//
+// Passes are added in an order that is valid to run them in and declare
+// which resources they read and write. compile() drops passes whose output
+// nobody uses and then orders the rest, keeping dependencies and otherwise
+// preferring to stay on the target the previous pass drew to. execute()
+// binds each pass's target, sets its viewport and state through the state
+// cache, clears if asked to and runs it. Transient resources get a target
+// from the RenderTargetManager right before their first use and give it
+// back after their last, so targets are shared between passes that don't
+// overlap.
+//
+// The graph is rebuilt every frame: reset(), declare, compile(), execute().
+class FrameGraph
+{
+
+public:
+
+	typedef int Resource;
+
+	class Pass
+	{
+	public:
+		Pass &read(Resource r) { reads.push_back(r); return *this; }
+		Pass &write(Resource r) { writes.push_back(r); return *this; }
+		Pass &state(const PassState &s) { passState = s; return *this; }
+		Pass &clear(float r, float g, float b, float a, bool depth = true);
+		// Runs even if nothing uses its output, e.g. it updates the simulation
+		Pass &keep() { sideEffects = true; return *this; }
+		// Binds targets and sets state itself without the state cache
+		Pass &ownsState() { external = true; return *this; }
+
+	private:
+		friend class FrameGraph;
+		const char *name;
+		void (*run)(void *) = nullptr;
+		void *closure = nullptr;
+		std::vector<Resource> reads;
+		std::vector<Resource> writes;
+		PassState passState;
+		bool clearColor = false;
+		bool clearDepth = false;
+		float clearValue[4] = {0, 0, 0, 0};
+		bool sideEffects = false;
+		bool external = false;
+		bool alive = false;
+	};
+
+	// Pass callbacks are kept in arena, which must not be reset before the
+	// graph is
+	FrameGraph(RenderTargetManager &targets, FrameArena &arena) : targets(targets), arena(arena) {}
+
+	void reset();
+
+	// The window's framebuffer. Whatever is in it at the end is the output
+	// of the graph.
+	Resource backbuffer(int width, int height);
+	// A target that only lives during this frame
+	Resource create(const char *name, const RenderTargetDesc &desc);
+	// A target that outlives the frame
+	Resource import(const char *name, RenderTarget &target, bool output);
+	// No target, only orders the passes that write and read it
+	Resource dependency(const char *name);
+
+	// name must outlive the frame (the profiler keeps it), use a literal
+	template<class F>
+	Pass &addPass(const char *name, F run)
+	{
+		Pass &p = addPass(name);
+		p.run = &invoke<F>;
+		p.closure = arena.make<F>(std::move(run));
+		return p;
+	}
+
+	void compile();
+	void execute();
+
+	// The target behind a resource while the graph executes, nullptr for the
+	// backbuffer and dependencies
+	RenderTarget *target(Resource r) const { return resources[r].target; }
+	int width(Resource r) const;
+	int height(Resource r) const;
+
+	GLStateCache &state() { return cache; }
+	int passCount() const { return (int)passes.size(); }
+	int culledCount() const { return (int)(passes.size() - order.size()); }
+
+private:
+
+	enum Kind { BACKBUFFER, TRANSIENT, IMPORTED, DEPENDENCY };
+
+	struct ResourceNode
+	{
+		const char *name;
+		Kind kind;
+		RenderTargetDesc desc;
+		RenderTarget *target = nullptr;
+		bool output = false;
+		int firstUse = -1;
+		int lastUse = -1;
+	};
+
+	template<class F>
+	static void invoke(void *closure) { (*static_cast<F *>(closure))(); }
+
+	Pass &addPass(const char *name);
+	Resource add(const ResourceNode &node);
+	bool dependsOn(int later, int earlier) const;
+	GLuint framebuffer(const Pass &pass, int &w, int &h) const;
+
+	RenderTargetManager &targets;
+	FrameArena &arena;
+	GLStateCache cache;
+	std::vector<ResourceNode> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order;
+	// read and write lists of earlier frames' passes, reused
+	std::vector<std::vector<Resource> > spareLists;
+
+};
+
+#endif // LAB471_FRAMEGRAPH_H_INCLUDED
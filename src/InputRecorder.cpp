@@ -0,0 +1,243 @@
+#include "InputRecorder.h"
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+
+const char Magic[4] = { 'S', 'S', 'I', 'R' };
+const uint16_t Version = 1;
+
+void writeBytes(FILE *f, const void *p, size_t n)
+{
+	fwrite(p, 1, n, f);
+}
+
+// Little endian helpers so recordings are portable between machines
+void writeU16(FILE *f, uint16_t v)
+{
+	uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+	writeBytes(f, b, 2);
+}
+
+void writeU32(FILE *f, uint32_t v)
+{
+	uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+	writeBytes(f, b, 4);
+}
+
+void writeU64(FILE *f, uint64_t v)
+{
+	writeU32(f, (uint32_t)v);
+	writeU32(f, (uint32_t)(v >> 32));
+}
+
+void writeF32(FILE *f, float v)
+{
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	writeU32(f, u);
+}
+
+struct Reader
+{
+	const vector<uint8_t> &data;
+	size_t pos;
+	bool ok;
+
+	explicit Reader(const vector<uint8_t> &d) : data(d), pos(0), ok(true) {}
+
+	uint8_t u8()
+	{
+		if (pos >= data.size())
+		{
+			ok = false;
+			return 0;
+		}
+		return data[pos++];
+	}
+	uint16_t u16() { uint16_t v = u8(); return v | (uint16_t)(u8() << 8); }
+	uint32_t u32() { uint32_t v = u16(); return v | ((uint32_t)u16() << 16); }
+	uint64_t u64() { uint64_t v = u32(); return v | ((uint64_t)u32() << 32); }
+	float f32()
+	{
+		uint32_t u = u32();
+		float v;
+		memcpy(&v, &u, sizeof(v));
+		return v;
+	}
+	uint32_t varint()
+	{
+		uint32_t v = 0;
+		for (int shift = 0; shift < 35 && ok; shift += 7)
+		{
+			uint8_t b = u8();
+			v |= (uint32_t)(b & 0x7f) << shift;
+			if (!(b & 0x80))
+			{
+				break;
+			}
+		}
+		return v;
+	}
+};
+
+}
+
+InputRecorder::~InputRecorder()
+{
+	if (file)
+	{
+		close(lastStep);
+	}
+}
+
+bool InputRecorder::open(const string &path, uint64_t seed)
+{
+	file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		cerr << "Could not open recording '" << path << "' for writing" << endl;
+		return false;
+	}
+	writeBytes(file, Magic, 4);
+	writeU16(file, Version);
+	writeU64(file, seed);
+	lastStep = 0;
+	count = 0;
+	return true;
+}
+
+void InputRecorder::writeVarint(uint32_t v)
+{
+	while (v >= 0x80)
+	{
+		fputc((int)(v & 0x7f) | 0x80, file);
+		v >>= 7;
+	}
+	fputc((int)v, file);
+}
+
+void InputRecorder::record(const InputEvent &e)
+{
+	if (!file)
+	{
+		return;
+	}
+	writeVarint(e.step - lastStep);
+	lastStep = e.step;
+	fputc(e.type, file);
+	if (e.type == InputEvent::KEY)
+	{
+		writeU16(file, (uint16_t)e.key);
+		fputc(e.action, file);
+	}
+	else if (e.type == InputEvent::SCROLL)
+	{
+		writeF32(file, e.dx);
+		writeF32(file, e.dy);
+	}
+	count++;
+}
+
+void InputRecorder::close(uint32_t step)
+{
+	if (!file)
+	{
+		return;
+	}
+	InputEvent end;
+	end.step = step < lastStep ? lastStep : step;
+	end.type = InputEvent::END;
+	record(end);
+	cout << "Recorded " << count - 1 << " input events over " << end.step << " steps" << endl;
+	fclose(file);
+	file = nullptr;
+}
+
+bool InputReplay::open(const string &path)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+	{
+		cerr << "Could not open recording '" << path << "'" << endl;
+		return false;
+	}
+	vector<uint8_t> data;
+	uint8_t buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		data.insert(data.end(), buf, buf + n);
+	}
+	fclose(f);
+
+	Reader in(data);
+	char magic[4];
+	for (int i = 0; i < 4; i++)
+	{
+		magic[i] = (char)in.u8();
+	}
+	if (!in.ok || memcmp(magic, Magic, 4) != 0 || in.u16() != Version)
+	{
+		cerr << "'" << path << "' is not a supported input recording" << endl;
+		return false;
+	}
+	seed = in.u64();
+
+	uint32_t step = 0;
+	bool ended = false;
+	while (in.ok && in.pos < data.size() && !ended)
+	{
+		InputEvent e;
+		step += in.varint();
+		e.step = step;
+		e.type = in.u8();
+		if (e.type == InputEvent::KEY)
+		{
+			e.key = in.u16();
+			e.action = in.u8();
+		}
+		else if (e.type == InputEvent::SCROLL)
+		{
+			e.dx = in.f32();
+			e.dy = in.f32();
+		}
+		else if (e.type == InputEvent::END)
+		{
+			endStep = step;
+			ended = true;
+			break;
+		}
+		else
+		{
+			in.ok = false;
+			break;
+		}
+		if (in.ok)
+		{
+			events.push_back(e);
+		}
+	}
+	if (!ended)
+	{
+		// truncated file, e.g. the recording run crashed: replay what is there
+		cerr << "Recording '" << path << "' has no end marker, replaying " << events.size() << " events" << endl;
+		endStep = events.empty() ? 0 : events.back().step;
+	}
+	next = 0;
+	opened = true;
+	return true;
+}
+
+const vector<InputEvent> &InputReplay::eventsFor(uint32_t step)
+{
+	current.clear();
+	while (next < events.size() && events[next].step <= step)
+	{
+		current.push_back(events[next++]);
+	}
+	return current;
+}
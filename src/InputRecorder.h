@@ -0,0 +1,92 @@
+//
+// Input recording and deterministic replay.
+//
+// A recording holds the world seed and every gameplay input event, each
+// stamped with the simulation step it has to be applied before. Since the
+// simulation advances one fixed step per frame and all randomness comes from
+// the seed, replaying a recording reproduces the flight exactly, whatever
+// the frame rate of the machine running it.
+//
+// File layout (little endian):
+//   "SSIR"  u16 version  u64 seed
+//   events: varint step delta, u8 type, payload
+//     KEY:    u16 key, u8 action
+//     SCROLL: f32 dx, f32 dy
+//     END:    no payload, marks the last recorded step
+//
+
+#pragma once
+#ifndef LAB471_INPUTRECORDER_H_INCLUDED
+#define LAB471_INPUTRECORDER_H_INCLUDED
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+struct InputEvent
+{
+	enum Type { KEY = 0, SCROLL = 1, END = 2 };
+
+	uint32_t step = 0;
+	uint8_t type = KEY;
+	int key = 0;
+	int action = 0;
+	float dx = 0;
+	float dy = 0;
+};
+
+class InputRecorder
+{
+
+public:
+
+	~InputRecorder();
+
+	bool open(const std::string &path, uint64_t seed);
+	bool isOpen() const { return file != nullptr; }
+	void record(const InputEvent &e);
+
+	// Writes the END marker for the given step and closes the file
+	void close(uint32_t lastStep);
+
+private:
+
+	void writeVarint(uint32_t v);
+
+	FILE *file = nullptr;
+	uint32_t lastStep = 0;
+	size_t count = 0;
+
+};
+
+class InputReplay
+{
+
+public:
+
+	bool open(const std::string &path);
+	bool isOpen() const { return opened; }
+	uint64_t getSeed() const { return seed; }
+
+	// Events that have to be applied before simulation step `step`
+	// (in recording order). Call with strictly increasing steps.
+	const std::vector<InputEvent> &eventsFor(uint32_t step);
+
+	// True once every recorded step has been simulated
+	bool finished(uint32_t step) const { return opened && step > endStep; }
+	uint32_t getEndStep() const { return endStep; }
+
+private:
+
+	bool opened = false;
+	uint64_t seed = 0;
+	uint32_t endStep = 0;
+	std::vector<InputEvent> events;
+	size_t next = 0;
+	std::vector<InputEvent> current;
+
+};
+
+#endif // LAB471_INPUTRECORDER_H_INCLUDED
@@ -0,0 +1,238 @@
+#include "LightClusters.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Program.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LIGHT_CLUSTERS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+using namespace glm;
+
+LightClusters::~LightClusters()
+{
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::computeBounds(float sx, float sy, float zNear, float zFar)
+{
+	if (boundsKey[0] == sx && boundsKey[1] == sy && boundsKey[2] == zNear && boundsKey[3] == zFar)
+	{
+		return;
+	}
+	boundsKey[0] = sx;
+	boundsKey[1] = sy;
+	boundsKey[2] = zNear;
+	boundsKey[3] = zFar;
+	this->zNear = zNear;
+	this->zFar = zFar;
+
+	// padding boxes are empty, nothing ever touches them
+	minX.assign(Clusters + 4, 1e30f);
+	minY.assign(Clusters + 4, 1e30f);
+	minZ.assign(Clusters + 4, 1e30f);
+	maxX.assign(Clusters + 4, -1e30f);
+	maxY.assign(Clusters + 4, -1e30f);
+	maxZ.assign(Clusters + 4, -1e30f);
+
+	for (int z = 0; z < Z; z++)
+	{
+		float dn = zNear * pow(zFar / zNear, z / (float)Z);
+		float df = zNear * pow(zFar / zNear, (z + 1) / (float)Z);
+		for (int y = 0; y < Y; y++)
+		{
+			float ny0 = 2.0f * y / Y - 1.0f;
+			float ny1 = 2.0f * (y + 1) / Y - 1.0f;
+			for (int x = 0; x < X; x++)
+			{
+				float nx0 = 2.0f * x / X - 1.0f;
+				float nx1 = 2.0f * (x + 1) / X - 1.0f;
+				// a tile's sides fan out with depth, the box holds both ends
+				int i = (z * Y + y) * X + x;
+				minX[i] = std::min(nx0 * dn, nx0 * df) / sx;
+				maxX[i] = std::max(nx1 * dn, nx1 * df) / sx;
+				minY[i] = std::min(ny0 * dn, ny0 * df) / sy;
+				maxY[i] = std::max(ny1 * dn, ny1 * df) / sy;
+				minZ[i] = -df;
+				maxZ[i] = -dn;
+			}
+		}
+	}
+}
+
+int LightClusters::slice(float depth) const
+{
+	int s = (int)floor(log(depth / zNear) / log(zFar / zNear) * Z);
+	return glm::clamp(s, 0, Z - 1);
+}
+
+int LightClusters::hitMask(int first, const vec3 &c, float r) const
+{
+#ifdef LIGHT_CLUSTERS_X86
+	const __m128 zero = _mm_setzero_ps();
+	__m128 cx = _mm_set1_ps(c.x);
+	__m128 cy = _mm_set1_ps(c.y);
+	__m128 cz = _mm_set1_ps(c.z);
+	// distance from the center to each box, per axis
+	__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[first]), cx), _mm_sub_ps(cx, _mm_loadu_ps(&maxX[first]))), zero);
+	__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[first]), cy), _mm_sub_ps(cy, _mm_loadu_ps(&maxY[first]))), zero);
+	__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[first]), cz), _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[first]))), zero);
+	__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+	return _mm_movemask_ps(_mm_cmple_ps(d2, _mm_set1_ps(r * r)));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		int k = first + i;
+		float dx = std::max(std::max(minX[k] - c.x, c.x - maxX[k]), 0.0f);
+		float dy = std::max(std::max(minY[k] - c.y, c.y - maxY[k]), 0.0f);
+		float dz = std::max(std::max(minZ[k] - c.z, c.z - maxZ[k]), 0.0f);
+		if (dx*dx + dy*dy + dz*dz <= r*r)
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+#endif
+}
+
+void LightClusters::build(const mat4 &P, const mat4 &V, float zNear, float zFar, const vector<PointLight> &lights)
+{
+	float sx = P[0][0];
+	float sy = P[1][1];
+	computeBounds(sx, sy, zNear, zFar);
+
+	int n = std::min((int)lights.size(), (int)MaxLights);
+	lightData.resize(8 * n);
+	pairs.clear();
+	for (int l = 0; l < n; l++)
+	{
+		const PointLight &light = lights[l];
+		float *data = &lightData[8 * l];
+		data[0] = light.position.x;
+		data[1] = light.position.y;
+		data[2] = light.position.z;
+		data[3] = light.radius;
+		data[4] = light.color.r;
+		data[5] = light.color.g;
+		data[6] = light.color.b;
+		data[7] = 0;
+
+		vec3 c(V * vec4(light.position, 1.0f));
+		float r = light.radius;
+		float depth = -c.z;
+		if (depth + r < zNear || depth - r > zFar)
+		{
+			continue;
+		}
+		int z0 = slice(std::max(depth - r, zNear));
+		int z1 = slice(std::min(depth + r, zFar));
+
+		// tiles covered by the sphere's box, everything once it reaches
+		// behind the near plane
+		int x0 = 0, x1 = X - 1, y0 = 0, y1 = Y - 1;
+		float dn = depth - r;
+		if (dn > zNear)
+		{
+			float df = depth + r;
+			float left = sx * std::min((c.x - r) / dn, (c.x - r) / df);
+			float right = sx * std::max((c.x + r) / dn, (c.x + r) / df);
+			float bottom = sy * std::min((c.y - r) / dn, (c.y - r) / df);
+			float top = sy * std::max((c.y + r) / dn, (c.y + r) / df);
+			if (right < -1 || left > 1 || top < -1 || bottom > 1)
+			{
+				continue;
+			}
+			x0 = glm::clamp((int)floor((left + 1) * .5f * X), 0, X - 1);
+			x1 = glm::clamp((int)floor((right + 1) * .5f * X), 0, X - 1);
+			y0 = glm::clamp((int)floor((bottom + 1) * .5f * Y), 0, Y - 1);
+			y1 = glm::clamp((int)floor((top + 1) * .5f * Y), 0, Y - 1);
+		}
+
+		for (int z = z0; z <= z1; z++)
+		{
+			for (int y = y0; y <= y1; y++)
+			{
+				int row = (z * Y + y) * X;
+				for (int x = x0; x <= x1; x += 4)
+				{
+					int mask = hitMask(row + x, c, r);
+					if (x1 - x < 3)
+					{
+						mask &= (1 << (x1 - x + 1)) - 1;
+					}
+					for (int i = 0; mask; i++, mask >>= 1)
+					{
+						if (mask & 1)
+						{
+							pairs.push_back((uint32_t)(row + x + i) << 16 | (uint32_t)l);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// counting sort by cluster, lights stay in order within a cluster
+	grid.assign(2 * Clusters, 0);
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		grid[2 * (pairs[i] >> 16) + 1]++;
+	}
+	uint32_t offset = 0;
+	for (int i = 0; i < Clusters; i++)
+	{
+		grid[2 * i] = offset;
+		offset += grid[2 * i + 1];
+		grid[2 * i + 1] = 0;
+	}
+	indices.resize(pairs.size());
+	for (size_t i = 0; i < pairs.size(); i++)
+	{
+		uint32_t cluster = pairs[i] >> 16;
+		indices[grid[2 * cluster] + grid[2 * cluster + 1]++] = (uint16_t)(pairs[i] & 0xFFFF);
+	}
+}
+
+void LightClusters::upload(int firstUnit)
+{
+	if (!buffers[0])
+	{
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+	}
+	// never empty, a buffer texture without storage is incomplete
+	static const float none[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	const void *data[3] = { grid.data(), indices.empty() ? none : (const void *)indices.data(), lightData.empty() ? none : (const void *)lightData.data() };
+	size_t sizes[3] = { grid.size() * sizeof(uint32_t), std::max(indices.size() * sizeof(uint16_t), sizeof(none)), std::max(lightData.size() * sizeof(float), sizeof(none)) };
+	GLenum formats[3] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+	for (int i = 0; i < 3; i++)
+	{
+		// a new store each time, the previous view's may still be in use
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::setUniforms(Program &prog, const GLint viewport[4], int firstUnit) const
+{
+	glUniform1i(prog.getUniform("ClusterGrid"), firstUnit);
+	glUniform1i(prog.getUniform("ClusterLights"), firstUnit + 1);
+	glUniform1i(prog.getUniform("LightData"), firstUnit + 2);
+	glUniform2f(prog.getUniform("ClusterOrigin"), (float)viewport[0], (float)viewport[1]);
+	glUniform2f(prog.getUniform("ClusterScale"), X / (float)std::max(viewport[2], 1), Y / (float)std::max(viewport[3], 1));
+	// slice = log(depth) * x + y
+	float range = log(zFar / zNear);
+	glUniform2f(prog.getUniform("ClusterDepth"), Z / range, -Z * log(zNear) / range);
+	glUniform3i(prog.getUniform("ClusterCount"), X, Y, Z);
+}
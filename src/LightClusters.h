@@ -0,0 +1,92 @@
+#pragma once
+#ifndef LAB471_LIGHTCLUSTERS_H_INCLUDED
+#define LAB471_LIGHTCLUSTERS_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+class Program;
+
+
+// A light that reaches `radius` units and fades out towards its edge
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+};
+
+// Clustered forward lighting: the view frustum is cut into X x Y screen
+// tiles and Z depth slices (exponentially spaced, so clusters are about as
+// deep as they are wide), and every cluster gets the list of lights whose
+// sphere touches it. Fragments look up their cluster and only loop over
+// those lights, so shading cost follows the lights nearby rather than the
+// total count.
+//
+// Assignment runs on the CPU every view: each light's sphere is bounded in
+// tiles and slices, then tested against the view space box of each cluster
+// in that range, four clusters at a time with SSE where available. The
+// lists go to the GPU as buffer textures:
+//
+//   ClusterGrid   RG32UI, (offset, count) into ClusterLights per cluster
+//   ClusterLights R16UI, light indices
+//   LightData     RGBA32F, position and radius, then color, per light
+class LightClusters
+{
+
+public:
+
+	static const int X = 16;
+	static const int Y = 9;
+	static const int Z = 24;
+	static const int MaxLights = 65535;
+
+	~LightClusters();
+
+	// Assigns lights (world space) to the clusters of the view P * V, whose
+	// near and far planes are at the given distances. Only P's scale
+	// terms are used, so oblique near planes are fine.
+	void build(const glm::mat4 &P, const glm::mat4 &V, float zNear, float zFar, const std::vector<PointLight> &lights);
+
+	// Sends the last build() to the GPU and binds the buffer textures to
+	// units firstUnit to firstUnit + 2
+	void upload(int firstUnit);
+
+	// Sets the samplers and cluster constants of a program drawing into
+	// viewport (x, y, width, height), see scene_frag.glsl
+	void setUniforms(Program &prog, const GLint viewport[4], int firstUnit) const;
+
+	int lightCount() const { return (int)lightData.size() / 8; }
+	// (cluster, light) pairs in the last build
+	int assignments() const { return (int)indices.size(); }
+
+private:
+
+	static const int Clusters = X * Y * Z;
+
+	void computeBounds(float sx, float sy, float zNear, float zFar);
+	int slice(float depth) const;
+	// Bit i set if the sphere touches cluster first + i, for four clusters
+	int hitMask(int first, const glm::vec3 &c, float r) const;
+
+	// view space cluster boxes, structure of arrays, padded so four wide
+	// loads never leave the array
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+	float boundsKey[4] = {0, 0, 0, 0};
+	float zNear = 0;
+	float zFar = 0;
+
+	std::vector<uint32_t> pairs;      // cluster << 16 | light
+	std::vector<uint32_t> grid;       // offset, count
+	std::vector<uint16_t> indices;
+	std::vector<float> lightData;
+
+	GLuint buffers[3] = {0, 0, 0};
+	GLuint textures[3] = {0, 0, 0};
+
+};
+
+#endif // LAB471_LIGHTCLUSTERS_H_INCLUDED
@@ -1,75 +1,70 @@
 
 #include "MatrixStack.h"
+#include "Transform.h"
+#include <cassert>
+#include <cstdio>
 #include <glm/gtc/matrix_transform.hpp>
 
-static const int MaxMatrixSize = 100;
-
 
 MatrixStack::MatrixStack()
 {
-	stack.push(glm::mat4(1.0));
+	reset();
+}
+
+void MatrixStack::reset()
+{
+	size = 1;
+	stack[0] = glm::mat4(1.0);
 }
 
 void MatrixStack::pushMatrix()
 {
-	const glm::mat4 &top = stack.top();
-	stack.push(top);
-	assert(stack.size() < MaxMatrixSize);
+	assert(size < Capacity);
+	stack[size] = stack[size - 1];
+	size++;
 }
 
 void MatrixStack::popMatrix()
 {
-	assert(!stack.empty());
-	stack.pop();
-
 	// There should always be one matrix left.
-	assert(!stack.empty());
+	assert(size > 1);
+	size--;
 }
 
 void MatrixStack::loadIdentity()
 {
-	glm::mat4 &top = stack.top();
-	top = glm::mat4(1.f);
+	stack[size - 1] = glm::mat4(1.f);
 }
 
 void MatrixStack::perspective(float fovy, float aspect, float zNear, float zFar)
 {
-	glm::mat4 &top = stack.top();
-	top *= glm::perspective(fovy, aspect, zNear, zFar);
+	multMatrix(glm::perspective(fovy, aspect, zNear, zFar));
 }
 
 void MatrixStack::translate(const glm::vec3 &offset)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 t = glm::translate(glm::mat4(1.f), offset);
-	top *= t;
+	MatrixMath::translate(stack[size - 1], offset);
 }
 
 void MatrixStack::scale(const glm::vec3 &scaleV)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), scaleV);
-	top *= s;
+	MatrixMath::scale(stack[size - 1], scaleV);
 }
 
-void MatrixStack::scale(float size)
+void MatrixStack::scale(float s)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 s = glm::scale(glm::mat4(1.f), glm::vec3(size));
-	top *= s;
+	MatrixMath::scale(stack[size - 1], glm::vec3(s));
 }
 
 void MatrixStack::rotate(float angle, const glm::vec3 &axis)
 {
-	glm::mat4 &top = stack.top();
-	glm::mat4 r = glm::rotate(glm::mat4(1.0), angle, axis);
-	top *= r;
+	MatrixMath::rotate(stack[size - 1], MatrixMath::rotation(angle, axis));
 }
 
 void MatrixStack::multMatrix(const glm::mat4 &matrix)
 {
-	glm::mat4 &top = stack.top();
-	top *= matrix;
+	glm::mat4 &top = stack[size - 1];
+	MatrixMath::multiply(top, matrix, top);
 }
 
 void MatrixStack::ortho(float left, float right, float bottom, float top, float zNear, float zFar)
@@ -78,25 +73,22 @@ void MatrixStack::ortho(float left, float right, float bottom, float top, float
 	assert(bottom != top);
 	assert(zFar != zNear);
 
-	glm::mat4 &ctm = stack.top();
-	ctm *= glm::ortho(left, right, bottom, top, zNear, zFar);
+	multMatrix(glm::ortho(left, right, bottom, top, zNear, zFar));
 }
 
 void MatrixStack::frustum(float left, float right, float bottom, float top, float zNear, float zFar)
 {
-	glm::mat4 &ctm = stack.top();
-	ctm *= glm::frustum(left, right, bottom, top, zNear, zFar);
+	multMatrix(glm::frustum(left, right, bottom, top, zNear, zFar));
 }
 
 void MatrixStack::lookAt(const glm::vec3 &eye, const glm::vec3 &target, const glm::vec3 &up)
 {
-	glm::mat4 &top = stack.top();
-	top *= glm::lookAt(eye, target, up);
+	multMatrix(glm::lookAt(eye, target, up));
 }
 
 const glm::mat4 &MatrixStack::topMatrix() const
 {
-	return stack.top();
+	return stack[size - 1];
 }
 
 void MatrixStack::print(const glm::mat4 &mat, const char *name)
@@ -124,5 +116,5 @@ void MatrixStack::print(const glm::mat4 &mat, const char *name)
 
 void MatrixStack::print(const char *name) const
 {
-	print(stack.top(), name);
+	print(stack[size - 1], name);
 }
@@ -3,7 +3,6 @@
 #ifndef LAB471_MATRIXSTACK_H_INCLUDED
 #define LAB471_MATRIXSTACK_H_INCLUDED
 
-#include <stack>
 #include <memory>
 
 #include "glm/glm.hpp"
@@ -12,15 +11,27 @@
 #include "glm/gtc/matrix_transform.hpp"
 
 
+// Fixed capacity, no allocation after construction. The transforms update
+// the top in place with MatrixMath instead of multiplying by a full matrix.
 class MatrixStack
 {
 
-	std::stack<glm::mat4> stack;
+public:
+
+	static const int Capacity = 32;
+
+private:
+
+	glm::mat4 stack[Capacity];
+	int size;
 
 public:
 
 	MatrixStack();
 
+	// Back to a single identity matrix, to reuse a stack for another frame
+	void reset();
+
 	// Copies the current matrix and adds it to the top of the stack
 	void pushMatrix();
 
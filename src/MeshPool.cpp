@@ -0,0 +1,132 @@
+#include "MeshPool.h"
+
+#include "GLSL.h"
+#include "Program.h"
+
+using namespace std;
+
+MeshPool::~MeshPool()
+{
+	for (map<Layout, GLuint>::iterator i = vaos.begin(); i != vaos.end(); ++i)
+	{
+		glDeleteVertexArrays(1, &i->second);
+	}
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ibo);
+}
+
+MeshPool::Range MeshPool::add(const vector<float> &pos, const vector<float> &nor, const vector<float> &tex, const vector<unsigned int> &ele)
+{
+	Range r;
+	r.count = (GLsizei)ele.size();
+	r.offset = indices.size() * sizeof(unsigned int);
+	r.baseVertex = vertexCount();
+
+	size_t n = pos.size() / 3;
+	for (size_t v = 0; v < n; v++)
+	{
+		vertices.insert(vertices.end(), &pos[3*v], &pos[3*v] + 3);
+		vertices.insert(vertices.end(), &nor[3*v], &nor[3*v] + 3);
+		if (tex.size() >= 2*(v + 1))
+		{
+			vertices.insert(vertices.end(), &tex[2*v], &tex[2*v] + 2);
+		}
+		else
+		{
+			vertices.push_back(0);
+			vertices.push_back(0);
+		}
+	}
+	indices.insert(indices.end(), ele.begin(), ele.end());
+	return r;
+}
+
+void MeshPool::upload()
+{
+	if (!vbo)
+	{
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ibo);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (map<Layout, GLuint>::iterator i = vaos.begin(); i != vaos.end(); ++i)
+	{
+		glDeleteVertexArrays(1, &i->second);
+	}
+	vaos.clear();
+	// the index buffer binding is vertex array state and core profiles have
+	// no default vertex array, so the indices go in through one of the
+	// pool's: the one without attributes, which has the IBO attached
+	Layout none = { -1, -1, -1 };
+	glBindVertexArray(vertexArray(none));
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+}
+
+GLuint MeshPool::vertexArray(const Layout &layout)
+{
+	map<Layout, GLuint>::iterator i = vaos.find(layout);
+	if (i != vaos.end())
+	{
+		return i->second;
+	}
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	GLsizei stride = Stride * sizeof(float);
+	GLint locations[3] = { layout.pos, layout.nor, layout.tex };
+	GLint sizes[3] = { 3, 3, 2 };
+	size_t offset = 0;
+	for (int a = 0; a < 3; a++)
+	{
+		if (locations[a] != -1)
+		{
+			GLSL::enableVertexAttribArray(locations[a]);
+			glVertexAttribPointer(locations[a], sizes[a], GL_FLOAT, GL_FALSE, stride, (const void *)offset);
+		}
+		offset += sizes[a] * sizeof(float);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	vaos[layout] = vao;
+	return vao;
+}
+
+void MeshPool::bind(const Program &prog)
+{
+	Layout layout;
+	layout.pos = prog.getAttribute("vertPos");
+	layout.nor = prog.getAttribute("vertNor");
+	layout.tex = prog.getAttribute("vertTex");
+	glBindVertexArray(vertexArray(layout));
+}
+
+void MeshPool::draw(const Range &range) const
+{
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.count, GL_UNSIGNED_INT, (const void *)range.offset, range.baseVertex);
+}
+
+void MeshPool::drawMulti(const Range *const *ranges, int count)
+{
+	if (count == 1 || !glMultiDrawElementsBaseVertex)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			draw(*ranges[i]);
+		}
+		return;
+	}
+	counts.resize(count);
+	offsets.resize(count);
+	baseVertices.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		counts[i] = ranges[i]->count;
+		offsets[i] = (const void *)ranges[i]->offset;
+		baseVertices[i] = ranges[i]->baseVertex;
+	}
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), count, baseVertices.data());
+}
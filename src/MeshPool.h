@@ -0,0 +1,83 @@
+#pragma once
+#ifndef LAB471_MESHPOOL_H_INCLUDED
+#define LAB471_MESHPOOL_H_INCLUDED
+
+#include <vector>
+#include <map>
+#include <memory>
+
+#include <glad/glad.h>
+
+class Program;
+
+
+// One vertex buffer and one index buffer that static meshes are
+// suballocated from.
+//
+// Vertices are interleaved position, normal, texture coordinate. Each mesh
+// keeps its own 0 based indices and is drawn with glDrawElementsBaseVertex,
+// several at once with glMultiDrawElementsBaseVertex, so drawing any number
+// of pooled meshes only needs the pool's vertex array bound once.
+//
+// Attribute locations are whatever the programs were linked with, so there
+// is one vertex array per distinct (vertPos, vertNor, vertTex) location
+// triple, usually one or two.
+class MeshPool
+{
+
+public:
+
+	struct Range
+	{
+		GLsizei count = 0;         // indices
+		size_t offset = 0;         // into the index buffer, in bytes
+		GLint baseVertex = 0;
+	};
+
+	~MeshPool();
+
+	// Appends a mesh. Normals must be present, texture coordinates may be
+	// empty. Takes effect with the next upload().
+	Range add(const std::vector<float> &pos, const std::vector<float> &nor, const std::vector<float> &tex, const std::vector<unsigned int> &ele);
+
+	// Sends everything added so far to the GPU, replacing the buffers
+	void upload();
+
+	// Binds the vertex array matching prog's attribute locations
+	void bind(const Program &prog);
+
+	// Draw with the pool bound for the current program
+	void draw(const Range &range) const;
+	void drawMulti(const Range *const *ranges, int count);
+
+	int vertexCount() const { return (int)(vertices.size() / Stride); }
+	int indexCount() const { return (int)indices.size(); }
+
+private:
+
+	static const int Stride = 8;
+
+	struct Layout
+	{
+		GLint pos, nor, tex;
+		bool operator<(const Layout &o) const
+		{
+			return pos != o.pos ? pos < o.pos : nor != o.nor ? nor < o.nor : tex < o.tex;
+		}
+	};
+
+	GLuint vertexArray(const Layout &layout);
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+	std::map<Layout, GLuint> vaos;
+
+	std::vector<GLsizei> counts;
+	std::vector<const void *> offsets;
+	std::vector<GLint> baseVertices;
+
+};
+
+#endif // LAB471_MESHPOOL_H_INCLUDED
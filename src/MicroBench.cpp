@@ -0,0 +1,368 @@
+#include "MicroBench.h"
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <stack>
+
+#include "Particle.h"
+#include "ParticleKernel.h"
+#include "RadixSort.h"
+#include "MatrixStack.h"
+#include "Transform.h"
+#include "NBody.h"
+#include "ThreadPool.h"
+#include "Random.h"
+#include "PoissonDisk.h"
+
+using namespace std;
+
+namespace
+{
+
+typedef chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// keeps results alive so the optimizer can't drop the work being timed
+volatile float sink;
+
+// MatrixStack as it used to be: std::stack storage, every transform a full
+// 4x4 multiply
+class LegacyMatrixStack
+{
+	std::stack<glm::mat4> stack;
+
+public:
+
+	LegacyMatrixStack() { stack.push(glm::mat4(1.0f)); }
+	void pushMatrix() { glm::mat4 top = stack.top(); stack.push(top); }
+	void popMatrix() { stack.pop(); }
+	void translate(const glm::vec3 &offset) { stack.top() *= glm::translate(glm::mat4(1.0f), offset); }
+	void scale(const glm::vec3 &s) { stack.top() *= glm::scale(glm::mat4(1.0f), s); }
+	void rotate(float angle, const glm::vec3 &axis) { stack.top() *= glm::rotate(glm::mat4(1.0f), angle, axis); }
+	const glm::mat4 &topMatrix() const { return stack.top(); }
+};
+
+}
+
+namespace MicroBench
+{
+
+void particles(int count, int steps)
+{
+	const float h = 0.01f;
+	const vec3 g(0.0f, -0.098f, 0.0f);
+	const vec3 c(0.5f, 0.2f, 0.0f);
+	const vec2 life(2.0f, 3.0f);
+
+	printf("particles: %d particles x %d steps\n", count, steps);
+
+	// Baseline: one heap allocated Particle per particle, as particleSys used to do
+	srand(1);
+	vector<shared_ptr<Particle> > objects;
+	for (int i = 0; i < count; i++)
+	{
+		shared_ptr<Particle> p = make_shared<Particle>(vec3(0.0f));
+		p->load(vec3(0.0f), 1.0f, vec3(0.0f), vec3(1.0f), c, life);
+		objects.push_back(p);
+	}
+	float t = 0.0f;
+	Clock::time_point start = Clock::now();
+	for (int s = 0; s < steps; s++)
+	{
+		for (size_t i = 0; i < objects.size(); i++)
+		{
+			objects[i]->update(t, h, g, vec3(0.0f));
+		}
+		t += h;
+	}
+	double baseline = secondsSince(start);
+	sink = objects[count / 2]->getPosition().x;
+	printf("  %-16s %8.3f ms  %6.2f ns/particle\n", "Particle::update", baseline*1e3, baseline*1e9/((double)count*steps));
+
+	// Kernel, same initial state on every path
+	ParticleBlock block;
+	block.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const vec3 &v = objects[i]->getVelocity();
+		block.vx[i] = v.x;
+		block.vy[i] = v.y;
+		block.vz[i] = v.z;
+		block.tEnd[i] = 0.5f + (i % 97) / 97.0f * life.t;
+		block.invLife[i] = 1.0f / block.tEnd[i];
+	}
+	const ParticleKernel::Path paths[] = { ParticleKernel::SCALAR, ParticleKernel::SSE, ParticleKernel::AVX2 };
+	for (int p = 0; p < 3; p++)
+	{
+		if (!ParticleKernel::isSupported(paths[p]))
+		{
+			printf("  %-16s not supported on this CPU\n", ParticleKernel::pathName(paths[p]));
+			continue;
+		}
+		ParticleBlock work = block;
+		t = 0.0f;
+		size_t dead = 0;
+		start = Clock::now();
+		for (int s = 0; s < steps; s++)
+		{
+			dead = ParticleKernel::integrate(paths[p], work, t, h);
+			t += h;
+		}
+		double elapsed = secondsSince(start);
+		sink = work.x[count / 2] + (float)dead;
+		printf("  %-16s %8.3f ms  %6.2f ns/particle  %5.2fx  (%d dead)\n", ParticleKernel::pathName(paths[p]),
+			elapsed*1e3, elapsed*1e9/((double)count*steps), baseline/elapsed, (int)dead);
+	}
+}
+
+void sortKeys(int count, int repeats)
+{
+	printf("sortkeys: %d keys x %d sorts\n", count, repeats);
+
+	// few programs, textures and meshes, scattered depths, like a frame's
+	// scene draws
+	srand(1);
+	vector<RadixSort::Entry> keys(count);
+	for (int i = 0; i < count; i++)
+	{
+		uint64_t program = rand() % 3;
+		uint64_t texture = rand() % 40;
+		uint64_t mesh = rand() % 16;
+		uint64_t depth = (uint64_t)rand() & 0xFFFFFF;
+		keys[i].key = (program << 54) | (texture << 44) | (mesh << 24) | depth;
+		keys[i].index = (uint32_t)i;
+	}
+
+	vector<RadixSort::Entry> work;
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+	{
+		work = keys;
+		std::sort(work.begin(), work.end(), [](const RadixSort::Entry &a, const RadixSort::Entry &b) { return a.key < b.key; });
+	}
+	double baseline = secondsSince(start);
+	sink = (float)work[count / 2].index;
+	printf("  %-16s %8.3f ms  %6.2f ns/key\n", "std::sort", baseline*1e3, baseline*1e9/((double)count*repeats));
+
+	vector<RadixSort::Entry> scratch;
+	start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+	{
+		work = keys;
+		RadixSort::sort(work, scratch);
+	}
+	double elapsed = secondsSince(start);
+	sink = (float)work[count / 2].index;
+	printf("  %-16s %8.3f ms  %6.2f ns/key  %5.2fx\n", "radix", elapsed*1e3, elapsed*1e9/((double)count*repeats), baseline/elapsed);
+}
+
+void matrixStack(int count, int repeats)
+{
+	printf("matrixstack: %d objects x %d frames\n", count, repeats);
+
+	// an asteroid belt: orbit, offset, spin, size per object
+	vector<float> angle(count), radius(count), size(count);
+	for (int i = 0; i < count; i++)
+	{
+		angle[i] = i * 0.37f;
+		radius[i] = 20.0f + (i % 50);
+		size[i] = 0.5f + (i % 7) * 0.1f;
+	}
+	const vec3 up(0, 1, 0), right(1, 0, 0);
+
+	// a fresh heap allocated stack per frame, as render() used to do
+	Clock::time_point start = Clock::now();
+	float sum = 0;
+	for (int r = 0; r < repeats; r++)
+	{
+		shared_ptr<LegacyMatrixStack> Model = make_shared<LegacyMatrixStack>();
+		for (int i = 0; i < count; i++)
+		{
+			Model->pushMatrix();
+			Model->rotate(angle[i] + r * 0.01f, up);
+			Model->translate(vec3(radius[i], 0, 0));
+			Model->rotate(-r * 0.02f, right);
+			Model->scale(vec3(size[i]));
+			sum += Model->topMatrix()[3][0];
+			Model->popMatrix();
+		}
+	}
+	double baseline = secondsSince(start);
+	sink = sum;
+	printf("  %-16s %8.3f ms  %6.2f ns/object\n", "std::stack", baseline*1e3, baseline*1e9/((double)count*repeats));
+
+	MatrixStack stack;
+	sum = 0;
+	start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+	{
+		stack.reset();
+		for (int i = 0; i < count; i++)
+		{
+			stack.pushMatrix();
+			stack.rotate(angle[i] + r * 0.01f, up);
+			stack.translate(vec3(radius[i], 0, 0));
+			stack.rotate(-r * 0.02f, right);
+			stack.scale(vec3(size[i]));
+			sum += stack.topMatrix()[3][0];
+			stack.popMatrix();
+		}
+	}
+	double elapsed = secondsSince(start);
+	sink = sum;
+	printf("  %-16s %8.3f ms  %6.2f ns/object  %5.2fx\n", "MatrixStack", elapsed*1e3, elapsed*1e9/((double)count*repeats), baseline/elapsed);
+
+	sum = 0;
+	start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+	{
+		stack.reset();
+		for (int i = 0; i < count; i++)
+		{
+			Transform t = Transform::rotate(angle[i] + r * 0.01f, up) * Transform::translate(vec3(radius[i], 0, 0))
+				* Transform::rotate(-r * 0.02f, right) * Transform::scaling(vec3(size[i]));
+			stack.pushMatrix();
+			stack.multMatrix(t.matrix());
+			sum += stack.topMatrix()[3][0];
+			stack.popMatrix();
+		}
+	}
+	elapsed = secondsSince(start);
+	sink = sum;
+	printf("  %-16s %8.3f ms  %6.2f ns/object  %5.2fx\n", "Transform", elapsed*1e3, elapsed*1e9/((double)count*repeats), baseline/elapsed);
+}
+
+void nbody(int count, int checked)
+{
+	printf("nbody: %d bodies, accuracy on %d\n", count, checked);
+
+	// a flat disc of debris, every tenth body massless
+	RandomStream random(1);
+	vector<vec3> positions(count);
+	for (int i = 0; i < count; i++)
+	{
+		float angle = random.uniform(0.0f, 6.2831853f);
+		float radius = 20.0f + random.uniform(0.0f, 500.0f);
+		positions[i] = vec3(radius * cos(angle), random.uniform(-5.0f, 5.0f), radius * sin(angle));
+	}
+	ThreadPool pool;
+	NBody serial, threaded(&pool);
+	for (int i = 0; i < count; i++)
+	{
+		serial.add(positions[i], i % 10 ? 1.0f : 0.0f);
+		threaded.add(positions[i], i % 10 ? 1.0f : 0.0f);
+	}
+
+	const int steps = 3;
+	Clock::time_point start = Clock::now();
+	for (int s = 0; s < steps; s++)
+	{
+		serial.solve();
+	}
+	double baseline = secondsSince(start) / steps;
+	printf("  %-16s %8.3f ms  %6d nodes\n", "tree, 1 thread", baseline*1e3, serial.nodeCount());
+	start = Clock::now();
+	for (int s = 0; s < steps; s++)
+	{
+		threaded.solve();
+	}
+	double elapsed = secondsSince(start) / steps;
+	printf("  tree, %-2d threads %8.3f ms  %5.2fx\n", pool.threadCount(), elapsed*1e3, baseline/elapsed);
+
+	// the tree against every pair on a subset
+	NBody reference(&pool), tree(&pool);
+	for (int i = 0; i < checked; i++)
+	{
+		reference.add(positions[i], i % 10 ? 1.0f : 0.0f);
+		tree.add(positions[i], i % 10 ? 1.0f : 0.0f);
+	}
+	reference.bruteForce = true;
+	start = Clock::now();
+	reference.solve();
+	baseline = secondsSince(start);
+	printf("  %-16s %8.3f ms\n", "brute force", baseline*1e3);
+	const float thetas[] = { 0.3f, 0.5f, 0.8f };
+	for (int t = 0; t < 3; t++)
+	{
+		tree.theta = thetas[t];
+		start = Clock::now();
+		tree.solve();
+		elapsed = secondsSince(start);
+		double mean = 0, worst = 0;
+		for (int i = 0; i < checked; i++)
+		{
+			double error = length(tree.acceleration(i) - reference.acceleration(i)) / length(reference.acceleration(i));
+			mean += error;
+			worst = max(worst, error);
+		}
+		printf("  theta %.1f        %8.3f ms  %5.2fx  error mean %.2e max %.2e\n", thetas[t], elapsed*1e3, baseline/elapsed, mean/checked, worst);
+	}
+}
+
+void poisson(float worldScale)
+{
+	// the planets of initGeom()
+	const int count = (int)(50 * worldScale);
+	const float inner = 20.0f, outer = 100.0f * sqrt(worldScale), minDistance = 15.0f;
+	printf("poisson: %d planets in %.0f..%.0f, %.0f apart\n", count, inner, outer, minDistance);
+
+	PoissonDisk disk;
+	vector<vec2> points;
+	const int repeats = 5;
+	Clock::time_point start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+	{
+		RandomStream random(r + 1);
+		disk.sample(random, inner, outer, minDistance, count, points);
+	}
+	double elapsed = secondsSince(start) / repeats;
+	sink = points.empty() ? 0.0f : points.back().x;
+	printf("  %-16s %8.3f ms  %6d points  %6.1f ns/point\n", "sample", elapsed*1e3, (int)points.size(), elapsed*1e9/max<size_t>(points.size(), 1));
+}
+
+int run(const string &name)
+{
+	bool all = name.empty();
+	bool ran = false;
+	if (all || name == "particles")
+	{
+		particles(100000, 200);
+		ran = true;
+	}
+	if (all || name == "sortkeys")
+	{
+		sortKeys(4096, 1000);
+		ran = true;
+	}
+	if (all || name == "matrixstack")
+	{
+		matrixStack(10000, 200);
+		ran = true;
+	}
+	if (all || name == "nbody")
+	{
+		nbody(100000, 10000);
+		ran = true;
+	}
+	if (all || name == "poisson")
+	{
+		poisson(2000.0f);
+		ran = true;
+	}
+	if (!ran)
+	{
+		cerr << "Unknown micro-benchmark '" << name << "'" << endl;
+		return 1;
+	}
+	return 0;
+}
+
+}
@@ -0,0 +1,37 @@
+//
+// Stand-alone CPU micro-benchmarks, run with `--microbench [name]` instead
+// of opening a window.
+//
+
+#pragma once
+#ifndef LAB471_MICROBENCH_H_INCLUDED
+#define LAB471_MICROBENCH_H_INCLUDED
+
+#include <string>
+
+
+namespace MicroBench
+{
+	// Runs the named benchmark, or all of them if name is empty.
+	// Returns a process exit code.
+	int run(const std::string &name);
+
+	// Particle::update against the SoA kernel on every supported path
+	void particles(int count, int steps);
+
+	// RadixSort against std::sort on render queue shaped keys
+	void sortKeys(int count, int repeats);
+
+	// MatrixStack and Transform against the old std::stack based stack
+	void matrixStack(int count, int repeats);
+
+	// Barnes-Hut timings on count bodies, and its error against brute force
+	// on the first checked of them
+	void nbody(int count, int checked);
+
+	// PoissonDisk placing the planets of a world of the given scale, count
+	// of them in the annulus main.cpp uses
+	void poisson(float worldScale);
+}
+
+#endif // LAB471_MICROBENCH_H_INCLUDED
@@ -0,0 +1,352 @@
+#include "NBody.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// 21 bits per axis, a level of the tree takes 3 bits of the key
+const int MaxLevel = 21;
+// the levels above are built serially, each node there below in parallel
+const int SplitLevel = 2;
+const int LeafSize = 8;
+// bodies per parallel task
+const int Chunk = 256;
+
+uint64_t spread(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x << 8) & 0x100f00f00f00f00full;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+	x = (x | x << 2) & 0x1249249249249249ull;
+	return x;
+}
+
+uint64_t cell(float x)
+{
+	return (uint64_t)std::min(std::max(x, 0.0f), (float)((1 << MaxLevel) - 1));
+}
+
+}
+
+NBody::NBody(ThreadPool *pool) : pool(pool)
+{
+}
+
+void NBody::clear()
+{
+	positions.clear();
+	masses.clear();
+}
+
+int NBody::add(const vec3 &position, float mass)
+{
+	positions.push_back(position);
+	masses.push_back(mass);
+	return (int)positions.size() - 1;
+}
+
+template<class F>
+void NBody::parallel(int count, F &f)
+{
+	if (pool)
+	{
+		pool->parallelFor(count, f);
+		return;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		f(i);
+	}
+}
+
+void NBody::sortBodies()
+{
+	order.clear();
+	massless.clear();
+	vec3 lo(INFINITY), hi(-INFINITY);
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		if (masses[i] > 0)
+		{
+			lo = min(lo, positions[i]);
+			hi = max(hi, positions[i]);
+		}
+	}
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		if (masses[i] <= 0)
+		{
+			massless.push_back((int)i);
+			continue;
+		}
+		RadixSort::Entry e;
+		e.key = 0;
+		e.index = (uint32_t)i;
+		order.push_back(e);
+	}
+	if (order.empty())
+	{
+		return;
+	}
+
+	boundsCenter = (lo + hi) * 0.5f;
+	vec3 extent = hi - lo;
+	boundsHalfSize = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f)) * 0.5f * 1.0001f;
+	vec3 corner = boundsCenter - vec3(boundsHalfSize);
+	float cells = (float)(1 << MaxLevel) / (2.0f * boundsHalfSize);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		vec3 c = (positions[order[i].index] - corner) * cells;
+		order[i].key = spread(cell(c.x)) << 2 | spread(cell(c.y)) << 1 | spread(cell(c.z));
+	}
+	RadixSort::sort(order, scratch);
+
+	sortedPositions.resize(order.size());
+	sortedMasses.resize(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		sortedPositions[i] = positions[order[i].index];
+		sortedMasses[i] = masses[order[i].index];
+	}
+}
+
+void NBody::build(vector<Node> &out, int n, int level, bool split)
+{
+	int begin = out[n].begin, end = out[n].end;
+	if (end - begin <= LeafSize || level == MaxLevel)
+	{
+		return;
+	}
+	if (split && level == SplitLevel)
+	{
+		if (subtreeCount == (int)subtrees.size())
+		{
+			subtrees.push_back(Subtree());
+		}
+		Subtree &s = subtrees[subtreeCount++];
+		s.link = n;
+		s.level = level;
+		s.nodes.clear();
+		s.nodes.push_back(out[n]);
+		return;
+	}
+
+	// the range shares the key bits above this level, so the octant digit
+	// only grows through it
+	int shift = 3 * (MaxLevel - 1 - level);
+	float childHalf = out[n].halfSize * 0.5f;
+	vec3 center = out[n].center;
+	int first = (int)out.size();
+	int childCount = 0;
+	int b = begin;
+	for (int octant = 0; octant < 8 && b < end; octant++)
+	{
+		int e = (int)(partition_point(order.begin() + b, order.begin() + end, [shift, octant](const RadixSort::Entry &s) {
+			return (int)((s.key >> shift) & 7) <= octant;
+		}) - order.begin());
+		if (e == b)
+		{
+			continue;
+		}
+		Node child;
+		child.center = center + childHalf * vec3(octant & 4 ? 1.0f : -1.0f, octant & 2 ? 1.0f : -1.0f, octant & 1 ? 1.0f : -1.0f);
+		child.halfSize = childHalf;
+		child.firstChild = -1;
+		child.childCount = 0;
+		child.begin = b;
+		child.end = e;
+		out.push_back(child);
+		childCount++;
+		b = e;
+	}
+	out[n].firstChild = first;
+	out[n].childCount = childCount;
+	for (int c = 0; c < childCount; c++)
+	{
+		build(out, first + c, level + 1, split);
+	}
+}
+
+void NBody::finish(vector<Node> &out, int n)
+{
+	Node &node = out[n];
+	vec3 weighted(0.0f);
+	float mass = 0;
+	if (node.firstChild < 0)
+	{
+		for (int i = node.begin; i < node.end; i++)
+		{
+			weighted += sortedMasses[i] * sortedPositions[i];
+			mass += sortedMasses[i];
+		}
+	}
+	else
+	{
+		for (int c = node.firstChild; c < node.firstChild + node.childCount; c++)
+		{
+			weighted += out[c].mass * out[c].centerOfMass;
+			mass += out[c].mass;
+		}
+	}
+	node.mass = mass;
+	node.centerOfMass = weighted / mass;
+}
+
+void NBody::buildTree()
+{
+	nodes.clear();
+	subtreeCount = 0;
+	if (order.empty())
+	{
+		return;
+	}
+
+	Node root;
+	root.center = boundsCenter;
+	root.halfSize = boundsHalfSize;
+	root.firstChild = -1;
+	root.childCount = 0;
+	root.begin = 0;
+	root.end = (int)order.size();
+	nodes.push_back(root);
+	build(nodes, 0, 0, true);
+
+	// children always come after their parent, so summing up the masses is
+	// one pass backwards
+	auto buildSubtree = [this](int t) {
+		Subtree &s = subtrees[t];
+		build(s.nodes, 0, s.level, false);
+		for (int n = (int)s.nodes.size() - 1; n >= 0; n--)
+		{
+			finish(s.nodes, n);
+		}
+	};
+	parallel(subtreeCount, buildSubtree);
+
+	int top = (int)nodes.size();
+	for (int t = 0; t < subtreeCount; t++)
+	{
+		Subtree &s = subtrees[t];
+		// the subtree's root takes the place of the link node, its other
+		// nodes go to the end
+		int offset = (int)nodes.size() - 1;
+		nodes[s.link] = s.nodes[0];
+		nodes.insert(nodes.end(), s.nodes.begin() + 1, s.nodes.end());
+		for (int n = offset + 1; n < (int)nodes.size(); n++)
+		{
+			if (nodes[n].firstChild >= 0)
+			{
+				nodes[n].firstChild += offset;
+			}
+		}
+		if (nodes[s.link].firstChild >= 0)
+		{
+			nodes[s.link].firstChild += offset;
+		}
+	}
+	for (int n = top - 1; n >= 0; n--)
+	{
+		finish(nodes, n);
+	}
+}
+
+vec3 NBody::treeAcceleration(const vec3 &p, int self) const
+{
+	const float theta2 = theta * theta;
+	const float eps2 = softening * softening;
+	vec3 a(0.0f);
+	int stack[8 * MaxLevel + 8];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0)
+	{
+		const Node &node = nodes[stack[--top]];
+		if (node.firstChild < 0)
+		{
+			for (int i = node.begin; i < node.end; i++)
+			{
+				if (i == self)
+				{
+					continue;
+				}
+				vec3 r = sortedPositions[i] - p;
+				float d2 = dot(r, r) + eps2;
+				a += (sortedMasses[i] / (d2 * sqrt(d2))) * r;
+			}
+			continue;
+		}
+		vec3 r = node.centerOfMass - p;
+		float d2 = dot(r, r);
+		float size = 2.0f * node.halfSize;
+		if (size * size < theta2 * d2)
+		{
+			d2 += eps2;
+			a += (node.mass / (d2 * sqrt(d2))) * r;
+			continue;
+		}
+		for (int c = node.firstChild; c < node.firstChild + node.childCount; c++)
+		{
+			stack[top++] = c;
+		}
+	}
+	return G * a;
+}
+
+vec3 NBody::directAcceleration(const vec3 &p, int self) const
+{
+	const float eps2 = softening * softening;
+	vec3 a(0.0f);
+	for (int i = 0; i < (int)sortedPositions.size(); i++)
+	{
+		if (i == self)
+		{
+			continue;
+		}
+		vec3 r = sortedPositions[i] - p;
+		float d2 = dot(r, r) + eps2;
+		a += (sortedMasses[i] / (d2 * sqrt(d2))) * r;
+	}
+	return G * a;
+}
+
+void NBody::solve()
+{
+	accelerations.assign(positions.size(), vec3(0.0f));
+	sortBodies();
+	if (order.empty())
+	{
+		return;
+	}
+	if (!bruteForce)
+	{
+		buildTree();
+	}
+	else
+	{
+		nodes.clear();
+	}
+
+	// massive bodies in tree order first, neighbours walk the same nodes,
+	// then the massless ones
+	int massive = (int)order.size();
+	int total = massive + (int)massless.size();
+	auto evaluate = [this, massive, total](int task) {
+		int end = std::min(total, (task + 1) * Chunk);
+		for (int k = task * Chunk; k < end; k++)
+		{
+			int self = k < massive ? k : -1;
+			int body = k < massive ? (int)order[k].index : massless[k - massive];
+			accelerations[body] = bruteForce ? directAcceleration(positions[body], self) : treeAcceleration(positions[body], self);
+		}
+	};
+	parallel((total + Chunk - 1) / Chunk, evaluate);
+}
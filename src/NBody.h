@@ -0,0 +1,107 @@
+//
+// Gravity between many bodies, Barnes-Hut on an octree.
+//
+
+#pragma once
+#ifndef LAB471_NBODY_H_INCLUDED
+#define LAB471_NBODY_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "RadixSort.h"
+
+class ThreadPool;
+
+
+// Bodies are added every step and solve() computes the acceleration each
+// one feels from all the others. Massless bodies feel gravity without
+// causing any and are left out of the tree.
+//
+// The tree is built over the bodies sorted by Morton code, so every node is
+// a range of them. A node whose size over distance is below theta is taken
+// as one point mass at its centre of mass; theta = 0 opens every node and
+// gives the same result as bruteForce, only slower.
+class NBody
+{
+
+public:
+
+	explicit NBody(ThreadPool *pool = nullptr);
+
+	void clear();
+	// Index of the body, in the order added
+	int add(const glm::vec3 &position, float mass);
+	int size() const { return (int)positions.size(); }
+
+	void solve();
+	const glm::vec3 &acceleration(int i) const { return accelerations[i]; }
+
+	// Opening angle
+	float theta = 0.5f;
+	// Keeps close encounters finite
+	float softening = 0.01f;
+	float G = 1.0f;
+	// Every pair directly, as a reference for the tree
+	bool bruteForce = false;
+
+	int nodeCount() const { return (int)nodes.size(); }
+
+private:
+
+	struct Node
+	{
+		glm::vec3 center;
+		float halfSize;
+		glm::vec3 centerOfMass;
+		float mass;
+		// children are next to each other, -1 for a leaf
+		int firstChild;
+		int childCount;
+		// range of sorted bodies
+		int begin, end;
+	};
+
+	// a node at SplitLevel and everything below it
+	struct Subtree
+	{
+		int link;
+		int level;
+		std::vector<Node> nodes;
+	};
+
+	void sortBodies();
+	// Children of out[n], split stops at SplitLevel and leaves a Subtree
+	void build(std::vector<Node> &out, int n, int level, bool split);
+	void finish(std::vector<Node> &out, int n);
+	void buildTree();
+	glm::vec3 treeAcceleration(const glm::vec3 &p, int self) const;
+	glm::vec3 directAcceleration(const glm::vec3 &p, int self) const;
+	template<class F> void parallel(int count, F &f);
+
+	ThreadPool *pool;
+
+	std::vector<glm::vec3> positions;
+	std::vector<float> masses;
+	std::vector<glm::vec3> accelerations;
+
+	// massive bodies in Morton order, for the tree
+	std::vector<RadixSort::Entry> order;
+	std::vector<RadixSort::Entry> scratch;
+	std::vector<glm::vec3> sortedPositions;
+	std::vector<float> sortedMasses;
+	std::vector<int> massless;
+	glm::vec3 boundsCenter;
+	float boundsHalfSize = 0;
+
+	std::vector<Node> nodes;
+	// the levels below SplitLevel, built in parallel. Kept across solves
+	// with their storage, only the first subtreeCount are in use.
+	std::vector<Subtree> subtrees;
+	int subtreeCount = 0;
+
+};
+
+#endif // LAB471_NBODY_H_INCLUDED
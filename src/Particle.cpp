@@ -12,7 +12,7 @@
 #include <glm/gtc/random.hpp>
 
 
-float randFloat(float l, float h)
+static float randFloat(float l, float h)
 {
 	float r = rand() / (float) RAND_MAX;
 	return (1.0f - r) * l + r * h;
@@ -0,0 +1,203 @@
+#include "ParticleKernel.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PARTICLE_KERNEL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(PARTICLE_KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+
+void ParticleBlock::resize(size_t n)
+{
+	count = n;
+	size_t p = (n + ParticleKernel::Lanes - 1) / ParticleKernel::Lanes * ParticleKernel::Lanes;
+	x.assign(p, 0.0f);
+	y.assign(p, 0.0f);
+	z.assign(p, 0.0f);
+	vx.assign(p, 0.0f);
+	vy.assign(p, 0.0f);
+	vz.assign(p, 0.0f);
+	r.assign(p, 1.0f);
+	g.assign(p, 1.0f);
+	b.assign(p, 1.0f);
+	alpha.assign(p, 1.0f);
+	// padding never dies and never moves
+	tEnd.assign(p, 1e30f);
+	invLife.assign(p, 0.0f);
+	dead.assign(p, 0.0f);
+}
+
+namespace
+{
+
+int bitCount(int mask)
+{
+	int n = 0;
+	for (; mask; mask &= mask - 1)
+	{
+		n++;
+	}
+	return n;
+}
+
+size_t integrateScalar(ParticleBlock &p, float t, float h)
+{
+	size_t dead = 0;
+	for (size_t i = 0; i < p.padded(); i++)
+	{
+		float a = (p.tEnd[i] - t) * p.invLife[i];
+		float k = (a + a) * (a + a);
+		p.alpha[i] = a;
+		p.x[i] += h * p.vx[i] * k;
+		p.y[i] += h * p.vy[i] * k;
+		p.z[i] += h * p.vz[i] * k;
+		if (t > p.tEnd[i])
+		{
+			p.dead[i] = 1.0f;
+		}
+		dead += p.dead[i] != 0.0f;
+	}
+	return dead;
+}
+
+#ifdef PARTICLE_KERNEL_X86
+
+size_t integrateSSE(ParticleBlock &p, float t, float h)
+{
+	const __m128 vt = _mm_set1_ps(t);
+	const __m128 vh = _mm_set1_ps(h);
+	const __m128 one = _mm_set1_ps(1.0f);
+	size_t dead = 0;
+	for (size_t i = 0; i < p.padded(); i += 4)
+	{
+		__m128 tEnd = _mm_loadu_ps(&p.tEnd[i]);
+		__m128 a = _mm_mul_ps(_mm_sub_ps(tEnd, vt), _mm_loadu_ps(&p.invLife[i]));
+		__m128 a2 = _mm_add_ps(a, a);
+		__m128 k = _mm_mul_ps(a2, a2);
+		_mm_storeu_ps(&p.alpha[i], a);
+		_mm_storeu_ps(&p.x[i], _mm_add_ps(_mm_loadu_ps(&p.x[i]), _mm_mul_ps(_mm_mul_ps(vh, _mm_loadu_ps(&p.vx[i])), k)));
+		_mm_storeu_ps(&p.y[i], _mm_add_ps(_mm_loadu_ps(&p.y[i]), _mm_mul_ps(_mm_mul_ps(vh, _mm_loadu_ps(&p.vy[i])), k)));
+		_mm_storeu_ps(&p.z[i], _mm_add_ps(_mm_loadu_ps(&p.z[i]), _mm_mul_ps(_mm_mul_ps(vh, _mm_loadu_ps(&p.vz[i])), k)));
+		__m128 died = _mm_or_ps(_mm_cmpgt_ps(vt, tEnd), _mm_cmpneq_ps(_mm_loadu_ps(&p.dead[i]), _mm_setzero_ps()));
+		_mm_storeu_ps(&p.dead[i], _mm_and_ps(died, one));
+		dead += bitCount(_mm_movemask_ps(died));
+	}
+	return dead;
+}
+
+TARGET_AVX2 size_t integrateAVX2(ParticleBlock &p, float t, float h)
+{
+	const __m256 vt = _mm256_set1_ps(t);
+	const __m256 vh = _mm256_set1_ps(h);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	size_t dead = 0;
+	for (size_t i = 0; i < p.padded(); i += 8)
+	{
+		__m256 tEnd = _mm256_loadu_ps(&p.tEnd[i]);
+		__m256 a = _mm256_mul_ps(_mm256_sub_ps(tEnd, vt), _mm256_loadu_ps(&p.invLife[i]));
+		__m256 a2 = _mm256_add_ps(a, a);
+		__m256 k = _mm256_mul_ps(a2, a2);
+		_mm256_storeu_ps(&p.alpha[i], a);
+		_mm256_storeu_ps(&p.x[i], _mm256_add_ps(_mm256_loadu_ps(&p.x[i]), _mm256_mul_ps(_mm256_mul_ps(vh, _mm256_loadu_ps(&p.vx[i])), k)));
+		_mm256_storeu_ps(&p.y[i], _mm256_add_ps(_mm256_loadu_ps(&p.y[i]), _mm256_mul_ps(_mm256_mul_ps(vh, _mm256_loadu_ps(&p.vy[i])), k)));
+		_mm256_storeu_ps(&p.z[i], _mm256_add_ps(_mm256_loadu_ps(&p.z[i]), _mm256_mul_ps(_mm256_mul_ps(vh, _mm256_loadu_ps(&p.vz[i])), k)));
+		__m256 died = _mm256_or_ps(_mm256_cmp_ps(vt, tEnd, _CMP_GT_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&p.dead[i]), _mm256_setzero_ps(), _CMP_NEQ_OQ));
+		_mm256_storeu_ps(&p.dead[i], _mm256_and_ps(died, one));
+		dead += bitCount(_mm256_movemask_ps(died));
+	}
+	return dead;
+}
+
+bool cpuHasAVX2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+	{
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // PARTICLE_KERNEL_X86
+
+}
+
+namespace ParticleKernel
+{
+
+bool isSupported(Path path)
+{
+#ifdef PARTICLE_KERNEL_X86
+	static const bool avx2 = cpuHasAVX2();
+	switch (path)
+	{
+		case AVX2: return avx2;
+		case SSE: return true;
+		default: return true;
+	}
+#else
+	return path == SCALAR;
+#endif
+}
+
+Path bestPath()
+{
+	static const Path best = isSupported(AVX2) ? AVX2 : (isSupported(SSE) ? SSE : SCALAR);
+	return best;
+}
+
+const char *pathName(Path path)
+{
+	switch (path)
+	{
+		case AVX2: return "avx2";
+		case SSE: return "sse";
+		default: return "scalar";
+	}
+}
+
+size_t integrate(Path path, ParticleBlock &block, float t, float h)
+{
+	if (!isSupported(path))
+	{
+		path = SCALAR;
+	}
+#ifdef PARTICLE_KERNEL_X86
+	switch (path)
+	{
+		case AVX2: return integrateAVX2(block, t, h);
+		case SSE: return integrateSSE(block, t, h);
+		default: break;
+	}
+#endif
+	return integrateScalar(block, t, h);
+}
+
+size_t integrate(ParticleBlock &block, float t, float h)
+{
+	return integrate(bestPath(), block, t, h);
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef LAB471_PARTICLEKERNEL_H_INCLUDED
+#define LAB471_PARTICLEKERNEL_H_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+// Structure-of-arrays particle storage. Every array is padded up to a
+// multiple of ParticleKernel::Lanes so the SIMD paths never need a scalar
+// tail; padding particles have a zero inverse lifespan and never die.
+struct ParticleBlock
+{
+	void resize(size_t n);
+	size_t size() const { return count; }
+	size_t padded() const { return x.size(); }
+
+	size_t count = 0;
+	std::vector<float> x, y, z;    // position
+	std::vector<float> vx, vy, vz; // velocity
+	std::vector<float> r, g, b;    // color
+	std::vector<float> alpha;      // remaining life fraction, also used as color alpha
+	std::vector<float> tEnd;       // time this particle dies
+	std::vector<float> invLife;    // 1 / lifespan
+	std::vector<float> dead;       // 1.0f once t > tEnd, 0.0f otherwise
+};
+
+namespace ParticleKernel
+{
+	static const size_t Lanes = 8;
+
+	enum Path { SCALAR, SSE, AVX2 };
+
+	// Integrates position, fades alpha and marks deaths for every particle
+	// in the block. Returns the number of particles that are dead.
+	// Uses the widest instruction set supported by the running CPU.
+	size_t integrate(ParticleBlock &block, float t, float h);
+
+	// Same as integrate() but forces a specific path. Falls back to the
+	// scalar path if the requested one isn't available on this CPU.
+	size_t integrate(Path path, ParticleBlock &block, float t, float h);
+
+	// The path integrate() picks on this machine
+	Path bestPath();
+	bool isSupported(Path path);
+	const char *pathName(Path path);
+}
+
+#endif // LAB471_PARTICLEKERNEL_H_INCLUDED
@@ -0,0 +1,130 @@
+#include "PoissonDisk.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// Cells around a point's cell that can hold one closer than minDistance:
+// two cells either way, less the corners, which are a full minDistance
+// off. Nearest first, so a candidate that doesn't fit is usually rejected
+// by the first few.
+const int Neighbours = 21;
+const int NeighbourOffsets[Neighbours][2] = {
+	{ 0, 0 },
+	{ -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+	{ -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 },
+	{ -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 },
+	{ -2, -1 }, { 2, -1 }, { -2, 1 }, { 2, 1 },
+	{ -1, -2 }, { 1, -2 }, { -1, 2 }, { 1, 2 },
+};
+
+}
+
+void PoissonDisk::fill(RandomStream &random, float inner, float outer, float minDistance, vector<vec2> &out, int tries)
+{
+	out.clear();
+	active.clear();
+	if (outer <= inner || minDistance <= 0)
+	{
+		return;
+	}
+
+	// a cell's diagonal is minDistance, so no two points share one. Two
+	// cells of border on every side keep the neighbours inside the grid.
+	const float cell = minDistance / sqrt(2.0f);
+	const int size = (int)ceil(2.0f * outer / cell) + 4;
+	// empty cells hold a point infinitely far away, it never gets too close
+	grid.assign((size_t)size * size, vec2(INFINITY));
+	const float inner2 = inner * inner, outer2 = outer * outer, min2 = minDistance * minDistance;
+	const float TwoPi = 6.2831853f;
+
+	int offsets[Neighbours];
+	for (int i = 0; i < Neighbours; i++)
+	{
+		offsets[i] = NeighbourOffsets[i][1] * size + NeighbourOffsets[i][0];
+	}
+	auto cellOf = [outer, cell, size](const vec2 &p) {
+		int x = std::min(size - 3, 2 + (int)((p.x + outer) / cell));
+		int y = std::min(size - 3, 2 + (int)((p.y + outer) / cell));
+		return y * size + x;
+	};
+	auto insert = [&](const vec2 &p) {
+		grid[cellOf(p)] = p;
+		active.push_back((int)out.size());
+		out.push_back(p);
+	};
+
+	vec2 first;
+	do
+	{
+		first = random.diskRand(outer);
+	} while (dot(first, first) < inner2);
+	insert(first);
+
+	// candidates go round the point in even steps from a random start, just
+	// beyond the minimum distance (Roberts' variant: fewer tries and denser
+	// than Bridson's random annulus)
+	const float step = TwoPi / tries;
+	const float c = cos(step), s = sin(step);
+	const float reach = minDistance * 1.0001f;
+	while (!active.empty())
+	{
+		// the newest active point rather than a random one, the front then
+		// moves through the grid in order and stays in cache
+		vec2 center = out[active.back()];
+		float start = random.uniform(0.0f, TwoPi);
+		vec2 direction(cos(start), sin(start));
+		bool placed = false;
+		for (int t = 0; t < tries && !placed; t++, direction = vec2(c * direction.x - s * direction.y, s * direction.x + c * direction.y))
+		{
+			vec2 p = center + reach * direction;
+			float r2 = dot(p, p);
+			if (r2 < inner2 || r2 > outer2)
+			{
+				continue;
+			}
+			const vec2 *around = &grid[cellOf(p)];
+			bool fits = true;
+			for (int n = 0; n < Neighbours && fits; n++)
+			{
+				vec2 d = around[offsets[n]] - p;
+				fits = dot(d, d) >= min2;
+			}
+			if (fits)
+			{
+				insert(p);
+				placed = true;
+			}
+		}
+		if (!placed)
+		{
+			active.pop_back();
+		}
+	}
+}
+
+void PoissonDisk::sample(RandomStream &random, float inner, float outer, float minDistance, int count, vector<vec2> &out)
+{
+	if (count <= 0)
+	{
+		out.clear();
+		return;
+	}
+	// no closer than needed to fit count: fill() places about 0.85 points per
+	// minDistance squared, the margin covers the edges
+	float area = 3.1415927f * (outer * outer - inner * inner);
+	float spacing = sqrt(0.7f * area / count);
+	fill(random, inner, outer, std::max(minDistance, spacing), out);
+	// the first count of a partial Fisher-Yates shuffle
+	int n = std::min(count, (int)out.size());
+	for (int i = 0; i < n; i++)
+	{
+		swap(out[i], out[random.uniformInt(i, (int)out.size() - 1)]);
+	}
+	out.resize(n);
+}
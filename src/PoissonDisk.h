@@ -0,0 +1,47 @@
+//
+// Poisson-disk sampling in an annulus (Bridson, "Fast Poisson Disk Sampling
+// in Arbitrary Dimensions", 2007).
+//
+
+#pragma once
+#ifndef LAB471_POISSONDISK_H_INCLUDED
+#define LAB471_POISSONDISK_H_INCLUDED
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Random.h"
+
+
+// Points no closer than minDistance to each other, in linear time. A
+// background grid with cells small enough to hold at most one point means
+// a candidate is only checked against the few points around it.
+//
+// The scratch grid is kept between calls, one sampler can place the moons
+// of every planet.
+class PoissonDisk
+{
+
+public:
+
+	// Fills the annulus inner <= |p| <= outer until no more points fit,
+	// trying `tries` candidates around each point before giving up on it.
+	// The points come out in the order they were found, growing from the
+	// first one.
+	void fill(RandomStream &random, float inner, float outer, float minDistance, std::vector<glm::vec2> &out, int tries = 12);
+
+	// At most count points picked at random from fill(), so they spread over
+	// the whole annulus however few are wanted. They are spaced further apart
+	// than minDistance if the annulus has room for that.
+	void sample(RandomStream &random, float inner, float outer, float minDistance, int count, std::vector<glm::vec2> &out);
+
+private:
+
+	// the point in each cell
+	std::vector<glm::vec2> grid;
+	std::vector<int> active;
+
+};
+
+#endif // LAB471_POISSONDISK_H_INCLUDED
@@ -0,0 +1,406 @@
+#include "Portal.h"
+#include <cmath>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+using namespace glm;
+
+PortalVisibility::~PortalVisibility()
+{
+	if (queries[0])
+	{
+		glDeleteQueries(Latency, queries);
+	}
+}
+
+PortalVisibility::PortalVisibility(PortalVisibility &&other) noexcept :
+	oldest(other.oldest), inFlight(other.inFlight), discard(other.discard), querying(other.querying),
+	occluded(other.occluded), stale(other.stale), age(other.age), imageRotation(other.imageRotation)
+{
+	// the query objects move with us
+	for (int i = 0; i < Latency; i++)
+	{
+		queries[i] = other.queries[i];
+		other.queries[i] = 0;
+	}
+	other.inFlight = 0;
+}
+
+bool PortalVisibility::sphereInFrustum(const mat4 &PV, const vec3 &center, float radius)
+{
+	// Gribb/Hartmann: the planes are sums and differences of the rows of PV
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = vec4(PV[0][i], PV[1][i], PV[2][i], PV[3][i]);
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = rows[3] + ((i & 1) ? -rows[i / 2] : rows[i / 2]);
+		float len = length(vec3(plane));
+		if (dot(vec3(plane), center) + plane.w < -radius * len)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void PortalVisibility::pollQueries()
+{
+	while (inFlight > 0)
+	{
+		GLuint q = queries[oldest];
+		GLint available = 0;
+		glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			break;
+		}
+		GLuint samples = 0;
+		glGetQueryObjectuiv(q, GL_QUERY_RESULT, &samples);
+		if (discard > 0)
+		{
+			discard--;
+		}
+		else
+		{
+			occluded = samples == 0;
+		}
+		oldest = (oldest + 1) % Latency;
+		inFlight--;
+	}
+}
+
+bool PortalVisibility::beginFrame(const mat4 &PV, const vec3 &center, float radius)
+{
+	pollQueries();
+	if (!sphereInFrustum(PV, center, radius))
+	{
+		// queries still in flight describe a view we've left
+		discard = inFlight;
+		occluded = false;
+		stale = true;
+		return false;
+	}
+	return true;
+}
+
+int PortalVisibility::interval(int imageWidth) const
+{
+	int n = 1;
+	while (n < MaxInterval && (long long)imageWidth * n < FullRateWidth)
+	{
+		n *= 2;
+	}
+	return n;
+}
+
+bool PortalVisibility::needsUpdate(int imageWidth, bool imageValid)
+{
+	age++;
+	if (!imageValid)
+	{
+		return true;
+	}
+	if (occluded)
+	{
+		stale = true;
+		return false;
+	}
+	return stale || age >= interval(imageWidth);
+}
+
+void PortalVisibility::rendered(const mat3 &viewRotation)
+{
+	imageRotation = viewRotation;
+	stale = false;
+	age = 0;
+}
+
+mat3 PortalVisibility::reprojection(const mat3 &viewRotation, float fovy, float aspect) const
+{
+	float sy = tan(fovy / 2);
+	float sx = sy * aspect;
+	// texture coordinates to a view space direction, u = v = 0.25 is the
+	// center of the image
+	mat3 toDir(vec3(4 * sx, 0, 0), vec3(0, 4 * sy, 0), vec3(-sx, -sy, -1));
+	// and back, with the perspective divide left to the shader
+	mat3 toTex(vec3(1 / (4 * sx), 0, 0), vec3(0, 1 / (4 * sy), 0), vec3(-.25f, -.25f, -1));
+	return toTex * imageRotation * transpose(viewRotation) * toDir;
+}
+
+void PortalVisibility::beginQuery()
+{
+	querying = inFlight < Latency;
+	if (!querying)
+	{
+		return;
+	}
+	if (!queries[0])
+	{
+		glGenQueries(Latency, queries);
+	}
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[(oldest + inFlight) % Latency]);
+}
+
+void PortalVisibility::endQuery()
+{
+	if (querying)
+	{
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+		inFlight++;
+		querying = false;
+	}
+}
+
+int PortalSystem::add(const vec3 &src, const vec3 &dst, float radius)
+{
+	Portal p;
+	p.src = src;
+	p.dst = dst;
+	p.radius = radius;
+	portals.push_back(std::move(p));
+	return (int)portals.size() - 1;
+}
+
+void PortalSystem::beginFrame(const mat4 &P, int maxWidth, float targetAspect, long long pixelBudget)
+{
+	portalP = P;
+	fovy = 2 * atan(1 / P[1][1]);
+	aspect = P[1][1] / P[0][0];
+	pool.configure(maxWidth, 256, targetAspect);
+	pixelsLeft = pixelBudget;
+	passesLeft = maxPasses;
+}
+
+int PortalSystem::imageWidth(const PortalView &view, const vec3 &cam, const Portal &p) const
+{
+	float d = distance(cam, p.src);
+	if (d <= p.radius)
+	{
+		return 1 << 30;
+	}
+	float screenRadius = tan(asin(p.radius / d)) * view.P[1][1] * view.height / 2.0f;
+	// the image wraps half way around the sphere
+	return (int)(2 * screenRadius * 3.14159265f / 2);
+}
+
+int PortalSystem::pickTier(Portal &p, int needed)
+{
+	// steps down only once the image comfortably fits the smaller tier so
+	// the resolution doesn't flicker
+	int tier = pool.tierFor(needed);
+	if (p.tier < 0 || p.tier >= pool.tierCount() || tier > p.tier)
+	{
+		p.tier = tier;
+	}
+	else if (tier < p.tier && needed < .75f * pool.tierWidth(p.tier - 1))
+	{
+		p.tier--;
+	}
+	return p.tier;
+}
+
+long long PortalSystem::cost(int tier) const
+{
+	// images cover the lower left quarter of their target
+	return (long long)(pool.tierWidth(tier) / 2) * (pool.tierHeight(tier) / 2);
+}
+
+void PortalSystem::assign(const PortalView &parent, PortalDraw &d)
+{
+	Portal &p = portals[d.portal];
+	d.view.P = portalP;
+	d.view.eye = p.dst;
+	d.view.heading = normalize(p.src - parent.eye);
+	d.view.V = lookAt(p.dst, p.dst + (p.src - parent.eye), vec3(0, 1, 0));
+	d.view.depth = parent.depth + 1;
+
+	// the image only covers the lower left quarter of the target
+	int needed = 2 * d.width;
+	int tier = parent.depth == 0 ? pickTier(p, needed) : pool.tierFor(needed);
+
+	RenderTarget *last = pool.find(p.imageTier, d.portal);
+	bool valid = last && last->fbo == p.imageFbo;
+	bool wanted = true;
+	if (parent.depth == 0)
+	{
+		wanted = p.visibility.needsUpdate(d.width, valid && p.imageTier == tier);
+	}
+
+	if (wanted && parent.depth < maxDepth && passesLeft > 0)
+	{
+		while (tier > 0 && cost(tier) > pixelsLeft)
+		{
+			tier--;
+		}
+		if (cost(tier) <= pixelsLeft)
+		{
+			d.target = parent.depth == 0 ? &pool.acquire(tier, d.portal) : &pool.acquireTransient(tier);
+			d.tier = tier;
+			d.render = true;
+			d.persistent = parent.depth == 0;
+			d.view.height = d.target->height / 2;
+			pixelsLeft -= cost(tier);
+			passesLeft--;
+			return;
+		}
+	}
+
+	// over budget or not due: show the last main view image, if any
+	if (valid)
+	{
+		d.target = last;
+		d.tier = p.imageTier;
+		d.persistent = true;
+	}
+}
+
+void PortalSystem::assignInPlace(const PortalView &parent, PortalDraw &d)
+{
+	Portal &p = portals[d.portal];
+	// the image in the pool is out of date once we're back in OFFSCREEN mode
+	p.imageFbo = 0;
+	vec3 offset = parent.eye - p.src;
+	vec3 n = normalize(p.src - parent.eye);
+	d.view.eye = p.dst + offset;
+	d.view.heading = n;
+	d.view.V = parent.V * translate(mat4(1.0f), p.src - p.dst);
+	d.view.height = parent.height;
+	d.view.depth = parent.depth + 1;
+	// cut at the near side of the exit sphere
+	vec3 onPlane = p.dst - n * p.radius;
+	d.view.P = obliqueProjection(parent.P, d.view.V, vec4(n, -dot(n, onPlane)));
+	d.render = parent.depth == 0 && passesLeft > 0 && !p.visibility.isOccluded();
+	if (d.render)
+	{
+		passesLeft--;
+	}
+}
+
+FrameVector<PortalDraw> PortalSystem::gather(const PortalView &view, FrameArena &arena)
+{
+	FrameVector<PortalDraw> draws((FrameAllocator<PortalDraw>(arena)));
+	if (mode == STENCIL && view.depth > 0)
+	{
+		return draws;
+	}
+	if (mode == OFFSCREEN && pool.tierCount() == 0)
+	{
+		return draws;
+	}
+	mat4 PV = view.P * view.V;
+	vec3 cam = vec3(inverse(view.V)[3]);
+	for (size_t i = 0; i < portals.size(); i++)
+	{
+		Portal &p = portals[i];
+		bool inFrustum = view.depth == 0 ?
+			p.visibility.beginFrame(PV, p.src, p.radius) :
+			PortalVisibility::sphereInFrustum(PV, p.src, p.radius);
+		if (!inFrustum)
+		{
+			continue;
+		}
+		PortalDraw d;
+		d.portal = (int)i;
+		d.width = imageWidth(view, cam, p);
+		d.distance = distance(cam, p.src);
+		draws.push_back(d);
+	}
+	sort(draws.begin(), draws.end(), [](const PortalDraw &a, const PortalDraw &b)
+	{
+		return a.width != b.width ? a.width > b.width : a.distance < b.distance;
+	});
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		if (mode == STENCIL)
+		{
+			assignInPlace(view, draws[i]);
+		}
+		else
+		{
+			assign(view, draws[i]);
+		}
+	}
+	return draws;
+}
+
+void PortalSystem::rendered(const PortalDraw &d)
+{
+	if (d.persistent)
+	{
+		Portal &p = portals[d.portal];
+		p.visibility.rendered(mat3(d.view.V));
+		p.imageTier = d.tier;
+		p.imageFbo = d.target->fbo;
+	}
+}
+
+void PortalSystem::release(const FrameVector<PortalDraw> &draws)
+{
+	for (size_t i = 0; i < draws.size(); i++)
+	{
+		if (draws[i].target && !draws[i].persistent)
+		{
+			pool.release(*draws[i].target);
+		}
+	}
+}
+
+mat3 PortalSystem::reprojection(const PortalDraw &d) const
+{
+	if (!d.persistent)
+	{
+		return mat3(1.0f);
+	}
+	return portals[d.portal].visibility.reprojection(mat3(d.view.V), fovy, aspect);
+}
+
+void PortalSystem::beginQuery(const PortalDraw &d)
+{
+	if (d.view.depth == 1)
+	{
+		portals[d.portal].visibility.beginQuery();
+	}
+}
+
+void PortalSystem::endQuery(const PortalDraw &d)
+{
+	if (d.view.depth == 1)
+	{
+		portals[d.portal].visibility.endQuery();
+	}
+}
+
+int PortalSystem::crossed(const vec3 &pos, float radius) const
+{
+	for (size_t i = 0; i < portals.size(); i++)
+	{
+		if (distance(portals[i].src, pos) < portals[i].radius + radius)
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+mat4 PortalSystem::obliqueProjection(const mat4 &P, const mat4 &V, const vec4 &plane)
+{
+	vec4 c = transpose(inverse(V)) * plane;
+	// the camera has to be on the clipped side, otherwise keep the frustum
+	if (c.w >= 0)
+	{
+		return P;
+	}
+	vec4 q = inverse(P) * vec4(c.x < 0 ? -1.0f : 1.0f, c.y < 0 ? -1.0f : 1.0f, 1, 1);
+	c *= 2 / dot(c, q);
+	mat4 oblique = P;
+	for (int i = 0; i < 4; i++)
+	{
+		oblique[i][2] = c[i] - P[i][3];
+	}
+	return oblique;
+}
@@ -0,0 +1,215 @@
+#pragma once
+#ifndef LAB471_PORTAL_H_INCLUDED
+#define LAB471_PORTAL_H_INCLUDED
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "RenderTarget.h"
+#include "FrameArena.h"
+
+
+// Decides whether a portal's offscreen pass has to run this frame.
+//
+// The portal is skipped entirely while its bounding sphere is outside the
+// view frustum, and its pass is skipped while the GPU reports the portal
+// fully occluded. Occlusion queries are read back a few frames late without
+// stalling, so a portal that reappears may show its previous image for a
+// frame or two. Portals that are visible but small on screen are updated at
+// a reduced rate; in between, the composite reprojects the last image with
+// reprojection().
+class PortalVisibility
+{
+
+public:
+
+	// Portals at least this many pixels wide update every frame, each halving
+	// below it doubles the interval, up to MaxInterval frames
+	static const int FullRateWidth = 512;
+	static const int MaxInterval = 8;
+	static const int Latency = 4;
+
+	PortalVisibility() {}
+	PortalVisibility(PortalVisibility &&other) noexcept;
+	PortalVisibility(const PortalVisibility &) = delete;
+	PortalVisibility &operator=(const PortalVisibility &) = delete;
+	~PortalVisibility();
+
+	// Call once per frame before anything else. Returns false if the sphere
+	// is outside the frustum of PV, in which case neither the portal pass nor
+	// the portal itself need to be drawn.
+	bool beginFrame(const glm::mat4 &PV, const glm::vec3 &center, float radius);
+
+	// Whether the portal image has to be re-rendered this frame. imageWidth
+	// is the on-screen width of the image in pixels, imageValid is false if
+	// the target holding the last image changed.
+	bool needsUpdate(int imageWidth, bool imageValid);
+
+	// Tells the portal its image was just rendered with this view rotation
+	void rendered(const glm::mat3 &viewRotation);
+
+	// Maps homogeneous portal texture coordinates (u, v, 1) for the current
+	// view rotation to those of the last rendered image. The image occupies
+	// the lower left quarter of the texture and was rendered with vertical
+	// field of view fovy and the given aspect ratio.
+	glm::mat3 reprojection(const glm::mat3 &viewRotation, float fovy, float aspect) const;
+
+	// Wrap the draw of the portal in the main pass. The result decides if the
+	// portal pass runs a few frames later.
+	void beginQuery();
+	void endQuery();
+
+	int interval(int imageWidth) const;
+	bool isOccluded() const { return occluded; }
+
+	static bool sphereInFrustum(const glm::mat4 &PV, const glm::vec3 &center, float radius);
+
+private:
+
+	void pollQueries();
+
+	GLuint queries[Latency] = {};
+	int oldest = 0;
+	int inFlight = 0;
+	int discard = 0;
+	bool querying = false;
+
+	bool occluded = false;
+	bool stale = true;
+	int age = 0;
+	glm::mat3 imageRotation = glm::mat3(1.0f);
+
+};
+
+// A wormhole: a sphere at src that shows, and leads to, the view from dst
+struct Portal
+{
+	glm::vec3 src;
+	glm::vec3 dst;
+	float radius;
+
+	// Main view state: the persistent image lives in slot (portal index) of
+	// imageTier in the pool
+	PortalVisibility visibility;
+	int tier = -1;
+	int imageTier = -1;
+	GLuint imageFbo = 0;
+};
+
+// A camera the scene is drawn from, either the main view or a view out of a
+// portal's exit
+struct PortalView
+{
+	glm::mat4 P;
+	glm::mat4 V;
+	glm::vec3 eye;     // where directions into portals are measured from
+	glm::vec3 heading; // direction the view faces portals from
+	int height = 0;    // viewport height in pixels
+	int depth = 0;     // 0 for the main view, +1 for each portal looked through
+};
+
+// One portal to draw in a view, produced by PortalSystem::gather()
+struct PortalDraw
+{
+	int portal;
+	int width;          // on-screen width of the image in pixels
+	float distance;
+	PortalView view;    // camera looking out of the portal's exit
+	RenderTarget *target = nullptr; // image to draw, nullptr if there is none
+	int tier = -1;
+	bool render = false;    // target has to be rendered from view first, or
+	                        // in STENCIL mode the view drawn through the portal
+	bool persistent = false; // target is the portal's main view image
+};
+
+// Keeps the portals of the world and decides every frame which portal
+// images get rendered, at what size and how deep.
+//
+// Images share one RenderTargetPool. Portals seen in the main view keep
+// their image across frames, images of portals seen through other portals
+// are transient and share memory once the pass showing them is done (see
+// release()). Per frame there is a budget on
+// recursion depth, the number of portal passes and the total number of
+// portal pixels rendered. Portals visible in a view are served largest on
+// screen first, which favors near and big portals; a portal that no longer
+// fits the budget gets a smaller tier, and if even that doesn't fit it
+// reuses its last main view image, reprojected. The cost of a frame is
+// bounded by the budget however many portals there are.
+//
+// In STENCIL mode there are no images: the portal's footprint is marked in
+// the stencil buffer and the view through it is drawn straight into the
+// main framebuffer, limited to those pixels. Its camera sits where the main
+// camera would be if the portal were a window onto dst and its near plane
+// is tilted to the portal so nothing between that camera and the exit is
+// drawn. Costs scale with the pixels the portal covers and nothing is
+// allocated, but portals seen through portals aren't drawn.
+class PortalSystem
+{
+
+public:
+
+	enum Mode { OFFSCREEN, STENCIL };
+
+	explicit PortalSystem(RenderTargetManager &targets) : pool(targets) {}
+
+	Mode mode = OFFSCREEN;
+	int maxDepth = 2;
+	int maxPasses = 6;
+
+	int add(const glm::vec3 &src, const glm::vec3 &dst, float radius);
+	int size() const { return (int)portals.size(); }
+	const Portal &operator[](int i) const { return portals[i]; }
+
+	// P is the projection all portal cameras use. Tiers are at most maxWidth
+	// wide with the given aspect ratio and at most pixelBudget pixels are
+	// rendered this frame.
+	void beginFrame(const glm::mat4 &P, int maxWidth, float targetAspect, long long pixelBudget);
+
+	// Portals visible from view, largest first, with their images assigned
+	// within this frame's budget. Call exactly once for the main view each
+	// frame, then for every rendered portal's view. The list lives in arena.
+	FrameVector<PortalDraw> gather(const PortalView &view, FrameArena &arena);
+
+	// Call after rendering d.target from d.view
+	void rendered(const PortalDraw &d);
+
+	// Call once the pass that drew these portals is done with their images
+	void release(const FrameVector<PortalDraw> &draws);
+
+	// Maps the texture coordinates of the portal sphere to the image
+	glm::mat3 reprojection(const PortalDraw &d) const;
+
+	// Wrap the draw of a portal in the main view, see PortalVisibility
+	void beginQuery(const PortalDraw &d);
+	void endQuery(const PortalDraw &d);
+
+	// Index of the portal whose sphere a sphere at pos touches, -1 if none
+	int crossed(const glm::vec3 &pos, float radius) const;
+
+	// P with its near plane replaced by plane (world space, normal pointing
+	// into the visible side) as seen through V. Lengyel's oblique frustum,
+	// the far plane stays roughly where it was.
+	static glm::mat4 obliqueProjection(const glm::mat4 &P, const glm::mat4 &V, const glm::vec4 &plane);
+
+private:
+
+	int imageWidth(const PortalView &view, const glm::vec3 &cam, const Portal &p) const;
+	int pickTier(Portal &p, int needed);
+	long long cost(int tier) const;
+	void assign(const PortalView &parent, PortalDraw &d);
+	void assignInPlace(const PortalView &parent, PortalDraw &d);
+
+	std::vector<Portal> portals;
+	RenderTargetPool pool;
+	glm::mat4 portalP = glm::mat4(1.0f);
+	float fovy = 0;
+	float aspect = 1; // of portalP
+
+	long long pixelsLeft = 0;
+	int passesLeft = 0;
+
+};
+
+#endif // LAB471_PORTAL_H_INCLUDED
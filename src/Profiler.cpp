@@ -0,0 +1,206 @@
+#include "Profiler.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+using namespace std;
+
+namespace
+{
+
+struct Event
+{
+	const char *name;
+	uint64_t start; // ns
+	uint64_t duration; // ns
+	uint32_t frame;
+	uint16_t thread; // GpuThread for GPU events
+	uint16_t depth;
+};
+
+const size_t Capacity = 1 << 16;
+const uint16_t GpuThread = 0xffff;
+
+// Queries still not available after this many frames are given up on
+const uint32_t MaxLatency = 16;
+
+struct PendingQuery
+{
+	GLuint query;
+	const char *name;
+	uint64_t submitted;
+	uint32_t frame;
+};
+
+Event ring[Capacity];
+atomic<uint64_t> written(0);
+
+atomic<uint32_t> frameIndex(0);
+atomic<uint16_t> nextThread(0);
+thread_local int threadId = -1;
+thread_local uint16_t depth = 0;
+
+// GPU state, only touched from the GL thread
+vector<PendingQuery> pending;
+vector<GLuint> freeQueries;
+bool gpuActive = false;
+uint64_t gpuCursor = 0; // end of the last GPU event on the trace timeline
+
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+uint16_t currentThread()
+{
+	if (threadId < 0)
+	{
+		threadId = nextThread++;
+	}
+	return (uint16_t)threadId;
+}
+
+void push(const char *name, uint64_t start, uint64_t duration, uint16_t thread, uint16_t d, uint32_t frame)
+{
+	Event &e = ring[written++ % Capacity];
+	e.name = name;
+	e.start = start;
+	e.duration = duration;
+	e.thread = thread;
+	e.depth = d;
+	e.frame = frame;
+}
+
+bool timerQueriesSupported()
+{
+	// GL_TIME_ELAPSED is core in 3.3
+	static const bool supported = GLAD_GL_VERSION_3_3 && glGetQueryObjectui64v != nullptr;
+	return supported;
+}
+
+}
+
+namespace Profiler
+{
+
+uint64_t now()
+{
+	return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void beginFrame()
+{
+	uint32_t frame = ++frameIndex;
+	if (pending.empty())
+	{
+		return;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		PendingQuery &p = pending[i];
+		GLint available = 0;
+		glGetQueryObjectiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &elapsed);
+			// The timer only gives durations: lay GPU work end to end, never
+			// earlier than the CPU submitted it.
+			uint64_t start = std::max(p.submitted, gpuCursor);
+			gpuCursor = start + elapsed;
+			push(p.name, start, elapsed, GpuThread, 0, p.frame);
+			freeQueries.push_back(p.query);
+		}
+		else if (frame - p.frame > MaxLatency)
+		{
+			// something went wrong with this one, don't wait forever
+			freeQueries.push_back(p.query);
+		}
+		else
+		{
+			pending[kept++] = p;
+		}
+	}
+	pending.resize(kept);
+}
+
+CpuScope::CpuScope(const char *name) :
+	name(name),
+	start(now())
+{
+	depth++;
+}
+
+CpuScope::~CpuScope()
+{
+	depth--;
+	push(name, start, now() - start, currentThread(), depth, frameIndex);
+}
+
+GpuScope::GpuScope(const char *name) :
+	query(0)
+{
+	if (gpuActive || !timerQueriesSupported())
+	{
+		return;
+	}
+	if (freeQueries.empty())
+	{
+		GLuint q;
+		glGenQueries(1, &q);
+		freeQueries.push_back(q);
+	}
+	query = freeQueries.back();
+	freeQueries.pop_back();
+	PendingQuery p;
+	p.query = query;
+	p.name = name;
+	p.submitted = now();
+	p.frame = frameIndex;
+	pending.push_back(p);
+	glBeginQuery(GL_TIME_ELAPSED, query);
+	gpuActive = true;
+}
+
+GpuScope::~GpuScope()
+{
+	if (query)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		gpuActive = false;
+	}
+}
+
+bool dump(const string &path)
+{
+	ofstream out(path);
+	if (!out.is_open())
+	{
+		cerr << "Could not write trace '" << path << "'" << endl;
+		return false;
+	}
+	uint64_t end = written;
+	uint64_t begin = end > Capacity ? end - Capacity : 0;
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << GpuThread << ", \"args\": {\"name\": \"GPU\"}}";
+	out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"main\"}}";
+	out.setf(ios::fixed);
+	out.precision(3);
+	for (uint64_t i = begin; i < end; i++)
+	{
+		const Event &e = ring[i % Capacity];
+		out << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << (e.thread == GpuThread ? "gpu" : "cpu")
+			<< "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+			<< ", \"ts\": " << e.start / 1000.0 << ", \"dur\": " << e.duration / 1000.0
+			<< ", \"args\": {\"frame\": " << e.frame << "}}";
+	}
+	out << "\n]}\n";
+	cout << "Wrote " << (end - begin) << " profiler events to " << path << endl;
+	return true;
+}
+
+}
@@ -0,0 +1,68 @@
+//
+// Lightweight frame profiler.
+//
+// PROFILE_SCOPE("name") times the enclosing block on the CPU,
+// PROFILE_GPU_SCOPE("name") times the GL commands issued inside it with a
+// GL_TIME_ELAPSED query. GPU results are read back a few frames later, and
+// only if they are ready, so profiling never stalls the pipeline. Timer
+// queries can't nest, so GPU scopes must not be nested either.
+//
+// Finished scopes go into a fixed size ring buffer; dump() writes its
+// contents as Chrome trace-event JSON (load it in chrome://tracing or
+// Perfetto). Build without ENABLE_PROFILER and the macros compile to nothing.
+//
+
+#pragma once
+#ifndef LAB471_PROFILER_H_INCLUDED
+#define LAB471_PROFILER_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+
+
+namespace Profiler
+{
+	// Call once per frame on the thread owning the GL context, before any
+	// GPU scope of that frame. Collects finished GPU queries.
+	void beginFrame();
+
+	// Writes everything in the ring buffer as Chrome trace JSON
+	bool dump(const std::string &path);
+
+	// Nanoseconds since the profiler started
+	uint64_t now();
+
+	class CpuScope
+	{
+	public:
+		explicit CpuScope(const char *name);
+		~CpuScope();
+	private:
+		const char *name;
+		uint64_t start;
+	};
+
+	class GpuScope
+	{
+	public:
+		explicit GpuScope(const char *name);
+		~GpuScope();
+	private:
+		unsigned query;
+	};
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_SCOPE(name) Profiler::CpuScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) Profiler::GpuScope PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
+#define PROFILE_BEGIN_FRAME() Profiler::beginFrame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_BEGIN_FRAME() ((void)0)
+#endif
+
+#endif // LAB471_PROFILER_H_INCLUDED
@@ -5,6 +5,7 @@
 #include <fstream>
 
 #include "GLSL.h"
+#include "ShaderCache.h"
 
 
 std::string readFileAsString(const std::string &fileName)
@@ -28,6 +29,26 @@ std::string readFileAsString(const std::string &fileName)
 	return result;
 }
 
+// Puts defines after the #version line, which has to stay first
+static std::string insertDefines(const std::string &source, const std::string &defines)
+{
+	if (defines.empty())
+	{
+		return source;
+	}
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+	{
+		return defines + source;
+	}
+	size_t line = source.find('\n', version);
+	if (line == std::string::npos)
+	{
+		return source + "\n" + defines;
+	}
+	return source.substr(0, line + 1) + defines + source.substr(line + 1);
+}
+
 void Program::setShaderNames(const std::string &v, const std::string &f)
 {
 	vShaderName = v;
@@ -36,65 +57,110 @@ void Program::setShaderNames(const std::string &v, const std::string &f)
 
 bool Program::init()
 {
-	GLint rc;
-
-	// Create shader handles
-	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
+	return begin() && finish();
+}
 
+bool Program::begin()
+{
 	// Read shader sources
-	std::string vShaderString = readFileAsString(vShaderName);
-	std::string fShaderString = readFileAsString(fShaderName);
+	std::string vShaderString = insertDefines(readFileAsString(vShaderName), defines);
+	std::string fShaderString = insertDefines(readFileAsString(fShaderName), defines);
+
+	pid = glCreateProgram();
+	cacheKey = ShaderCache::key(vShaderString, fShaderString);
+	cached = ShaderCache::load(cacheKey, pid);
+	if (cached)
+	{
+		return true;
+	}
+
+	// Create shader handles
+	VS = glCreateShader(GL_VERTEX_SHADER);
+	FS = glCreateShader(GL_FRAGMENT_SHADER);
 	const char *vshader = vShaderString.c_str();
 	const char *fshader = fShaderString.c_str();
 	CHECKED_GL_CALL(glShaderSource(VS, 1, &vshader, NULL));
 	CHECKED_GL_CALL(glShaderSource(FS, 1, &fshader, NULL));
 
-	// Compile vertex shader
+	// Compile and link, without asking for the results so the driver can
+	// work on them in the background
 	CHECKED_GL_CALL(glCompileShader(VS));
-	CHECKED_GL_CALL(glGetShaderiv(VS, GL_COMPILE_STATUS, &rc));
-	if (!rc)
+	CHECKED_GL_CALL(glCompileShader(FS));
+	CHECKED_GL_CALL(glAttachShader(pid, VS));
+	CHECKED_GL_CALL(glAttachShader(pid, FS));
+	ShaderCache::prepare(pid);
+	CHECKED_GL_CALL(glLinkProgram(pid));
+	return true;
+}
+
+bool Program::finish()
+{
+	GLint rc;
+
+	if (!cached)
 	{
-		if (isVerbose())
+		// Vertex shader
+		CHECKED_GL_CALL(glGetShaderiv(VS, GL_COMPILE_STATUS, &rc));
+		if (!rc)
 		{
-			GLSL::printShaderInfoLog(VS);
-			std::cout << "Error compiling vertex shader " << vShaderName << std::endl;
+			if (isVerbose())
+			{
+				GLSL::printShaderInfoLog(VS);
+				std::cout << "Error compiling vertex shader " << vShaderName << std::endl;
+			}
+			return false;
 		}
-		return false;
-	}
 
-	// Compile fragment shader
-	CHECKED_GL_CALL(glCompileShader(FS));
-	CHECKED_GL_CALL(glGetShaderiv(FS, GL_COMPILE_STATUS, &rc));
-	if (!rc)
-	{
-		if (isVerbose())
+		// Fragment shader
+		CHECKED_GL_CALL(glGetShaderiv(FS, GL_COMPILE_STATUS, &rc));
+		if (!rc)
 		{
-			GLSL::printShaderInfoLog(FS);
-			std::cout << "Error compiling fragment shader " << fShaderName << std::endl;
+			if (isVerbose())
+			{
+				GLSL::printShaderInfoLog(FS);
+				std::cout << "Error compiling fragment shader " << fShaderName << std::endl;
+			}
+			return false;
 		}
-		return false;
-	}
 
-	// Create the program and link
-	pid = glCreateProgram();
-	CHECKED_GL_CALL(glAttachShader(pid, VS));
-	CHECKED_GL_CALL(glAttachShader(pid, FS));
-	CHECKED_GL_CALL(glLinkProgram(pid));
-	CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
-	if (!rc)
-	{
-		if (isVerbose())
+		// Link
+		CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
+		if (!rc)
 		{
-			GLSL::printProgramInfoLog(pid);
-			std::cout << "Error linking shaders " << vShaderName << " and " << fShaderName << std::endl;
+			if (isVerbose())
+			{
+				GLSL::printProgramInfoLog(pid);
+				std::cout << "Error linking shaders " << vShaderName << " and " << fShaderName << std::endl;
+			}
+			return false;
 		}
-		return false;
+
+		ShaderCache::store(cacheKey, pid);
+		CHECKED_GL_CALL(glDetachShader(pid, VS));
+		CHECKED_GL_CALL(glDetachShader(pid, FS));
+		CHECKED_GL_CALL(glDeleteShader(VS));
+		CHECKED_GL_CALL(glDeleteShader(FS));
+		VS = FS = 0;
 	}
 
+	// Look up what was asked for before the program was linked
+	linked = true;
+	for (std::map<std::string, GLint>::iterator i = attributes.begin(); i != attributes.end(); ++i)
+	{
+		i->second = GLSL::getAttribLocation(pid, i->first.c_str(), isVerbose());
+	}
+	for (std::map<std::string, GLint>::iterator i = uniforms.begin(); i != uniforms.end(); ++i)
+	{
+		i->second = GLSL::getUniformLocation(pid, i->first.c_str(), isVerbose());
+	}
 	return true;
 }
 
+bool Program::isReady() const
+{
+	return cached || ShaderCache::completed(pid);
+}
+
 void Program::bind()
 {
 	CHECKED_GL_CALL(glUseProgram(pid));
@@ -107,12 +173,12 @@ void Program::unbind()
 
 void Program::addAttribute(const std::string &name)
 {
-	attributes[name] = GLSL::getAttribLocation(pid, name.c_str(), isVerbose());
+	attributes[name] = linked ? GLSL::getAttribLocation(pid, name.c_str(), isVerbose()) : -1;
 }
 
 void Program::addUniform(const std::string &name)
 {
-	uniforms[name] = GLSL::getUniformLocation(pid, name.c_str(), isVerbose());
+	uniforms[name] = linked ? GLSL::getUniformLocation(pid, name.c_str(), isVerbose()) : -1;
 }
 
 GLint Program::getAttribute(const std::string &name) const
@@ -142,3 +208,32 @@ GLint Program::getUniform(const std::string &name) const
 	}
 	return uniform->second;
 }
+
+GLint Program::getAttribute(const char *name) const
+{
+	for (std::map<std::string, GLint>::const_iterator i = attributes.begin(); i != attributes.end(); ++i)
+	{
+		if (i->first == name)
+		{
+			return i->second;
+		}
+	}
+	return -1;
+}
+
+GLint Program::getUniform(const char *name) const
+{
+	// a handful of uniforms per program, a scan is as quick as the lookup
+	for (std::map<std::string, GLint>::const_iterator i = uniforms.begin(); i != uniforms.end(); ++i)
+	{
+		if (i->first == name)
+		{
+			return i->second;
+		}
+	}
+	if (isVerbose())
+	{
+		std::cout << name << " is not a uniform variable" << std::endl;
+	}
+	return -1;
+}
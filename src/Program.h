@@ -21,7 +21,19 @@ public:
 	bool isVerbose() const { return verbose; }
 
 	void setShaderNames(const std::string &v, const std::string &f);
+	// Lines inserted after #version in both shaders, e.g. "#define LIGHTS 2\n"
+	void setDefines(const std::string &d) { defines = d; }
+	// Compiles and links, or loads the program from the shader cache
 	virtual bool init();
+
+	// init() in two halves: begin() starts compiling and linking and returns
+	// right away, finish() waits for the result. Other work in between
+	// overlaps with the driver compiling. Attributes and uniforms can be added
+	// before finish(), they are looked up once the program is linked.
+	bool begin();
+	bool finish();
+	// Whether finish() would return without waiting
+	bool isReady() const;
 	virtual void bind();
 	virtual void unbind();
 
@@ -29,15 +41,24 @@ public:
 	void addUniform(const std::string &name);
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
+	// Same for literals, without building a std::string every call
+	GLint getAttribute(const char *name) const;
+	GLint getUniform(const char *name) const;
 
 protected:
 
 	std::string vShaderName;
 	std::string fShaderName;
+	std::string defines;
 
 private:
 
 	GLuint pid = 0;
+	GLuint VS = 0;
+	GLuint FS = 0;
+	std::string cacheKey;
+	bool cached = false;
+	bool linked = false;
 	std::map<std::string, GLint> attributes;
 	std::map<std::string, GLint> uniforms;
 	bool verbose = true;
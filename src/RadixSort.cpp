@@ -0,0 +1,37 @@
+#include "RadixSort.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace RadixSort
+{
+
+void sort(vector<Entry> &entries, vector<Entry> &scratch)
+{
+	scratch.resize(entries.size());
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t count[257] = {0};
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			count[((entries[i].key >> shift) & 0xFF) + 1]++;
+		}
+		// every key has the same digit, the pass wouldn't move anything
+		if (std::find(count + 1, count + 257, entries.size()) != count + 257)
+		{
+			continue;
+		}
+		for (int b = 0; b < 256; b++)
+		{
+			count[b + 1] += count[b];
+		}
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			scratch[count[(entries[i].key >> shift) & 0xFF]++] = entries[i];
+		}
+		entries.swap(scratch);
+	}
+}
+
+}
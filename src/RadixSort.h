@@ -0,0 +1,27 @@
+//
+// Sorting of 64 bit keys with an index attached, e.g. draw keys or Morton
+// codes.
+//
+
+#pragma once
+#ifndef LAB471_RADIXSORT_H_INCLUDED
+#define LAB471_RADIXSORT_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+
+namespace RadixSort
+{
+	struct Entry
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// LSD radix sort by key, 8 bits per pass, stable. Passes in which every
+	// key has the same digit are skipped, so mostly constant fields cost
+	// nothing. scratch is resized to match and can be kept between calls.
+	void sort(std::vector<Entry> &entries, std::vector<Entry> &scratch);
+}
+
+#endif // LAB471_RADIXSORT_H_INCLUDED
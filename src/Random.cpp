@@ -0,0 +1,148 @@
+#include "Random.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+
+namespace
+{
+
+const uint32_t PhiloxM0 = 0xD2511F53u;
+const uint32_t PhiloxM1 = 0xCD9E8D57u;
+const uint32_t PhiloxW0 = 0x9E3779B9u;
+const uint32_t PhiloxW1 = 0xBB67AE85u;
+
+const float TwoPi = 6.28318530717958647692f;
+
+inline void mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+{
+	uint64_t p = (uint64_t)a * b;
+	hi = (uint32_t)(p >> 32);
+	lo = (uint32_t)p;
+}
+
+// splitmix64 finalizer, used to derive substream ids
+inline uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+inline float toFloat(uint32_t u)
+{
+	// top 24 bits, exactly representable, strictly below 1
+	return (u >> 8) * (1.0f / 16777216.0f);
+}
+
+}
+
+RandomStream::RandomStream(uint64_t seed, uint64_t stream) :
+	seed(seed),
+	stream(stream)
+{
+}
+
+RandomStream RandomStream::substream(uint64_t id) const
+{
+	return RandomStream(seed, mix64(stream + mix64(id + 0x9E3779B97F4A7C15ull)));
+}
+
+void RandomStream::block(uint64_t seed, uint64_t stream, uint64_t block, uint32_t out[4])
+{
+	uint32_t c0 = (uint32_t)block, c1 = (uint32_t)(block >> 32);
+	uint32_t c2 = (uint32_t)stream, c3 = (uint32_t)(stream >> 32);
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+	for (int round = 0; round < 10; round++)
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		mulhilo(PhiloxM0, c0, hi0, lo0);
+		mulhilo(PhiloxM1, c2, hi1, lo1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += PhiloxW0;
+		k1 += PhiloxW1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+uint32_t RandomStream::nextU32()
+{
+	uint64_t b = index >> 2;
+	if (b != cachedBlock)
+	{
+		block(seed, stream, b, cache);
+		cachedBlock = b;
+	}
+	return cache[index++ & 3];
+}
+
+float RandomStream::nextFloat()
+{
+	return toFloat(nextU32());
+}
+
+float RandomStream::uniform(float l, float h)
+{
+	return l + (h - l) * nextFloat();
+}
+
+int RandomStream::uniformInt(int l, int h)
+{
+	uint64_t range = (uint64_t)((int64_t)h - l) + 1;
+	return (int)(l + (int64_t)(((uint64_t)nextU32() * range) >> 32));
+}
+
+glm::vec2 RandomStream::diskRand(float radius)
+{
+	float r = radius * std::sqrt(nextFloat());
+	float theta = TwoPi * nextFloat();
+	return glm::vec2(r * std::cos(theta), r * std::sin(theta));
+}
+
+glm::vec3 RandomStream::ballRand(float radius)
+{
+	float z = 2.0f * nextFloat() - 1.0f;
+	float phi = TwoPi * nextFloat();
+	float r = radius * std::cbrt(nextFloat());
+	float s = std::sqrt(std::max(0.0f, 1.0f - z * z));
+	return glm::vec3(r * s * std::cos(phi), r * s * std::sin(phi), r * z);
+}
+
+void RandomStream::fill(uint32_t *out, size_t n)
+{
+	size_t i = 0;
+	// leading values up to a block boundary
+	while (i < n && (index & 3) != 0)
+	{
+		out[i++] = nextU32();
+	}
+	// whole blocks straight into the output
+	for (; i + 4 <= n; i += 4)
+	{
+		block(seed, stream, index >> 2, &out[i]);
+		index += 4;
+	}
+	while (i < n)
+	{
+		out[i++] = nextU32();
+	}
+}
+
+void RandomStream::fill(float *out, size_t n, float l, float h)
+{
+	fill(reinterpret_cast<uint32_t *>(out), n);
+	float range = h - l;
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t u;
+		memcpy(&u, &out[i], sizeof(u));
+		out[i] = l + range * toFloat(u);
+	}
+}
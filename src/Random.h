@@ -0,0 +1,74 @@
+//
+// Counter-based random number streams (Philox4x32-10, Salmon et al. 2011).
+//
+// Every value is a pure function of (seed, stream id, index), so a stream
+// can be split into substreams or jumped to any index without generating
+// the values in between. Work divided among threads therefore produces
+// bit-identical results whatever the thread count, as long as each piece
+// of work draws from its own substream or its own index range.
+//
+
+#pragma once
+#ifndef LAB471_RANDOM_H_INCLUDED
+#define LAB471_RANDOM_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+class RandomStream
+{
+
+public:
+
+	explicit RandomStream(uint64_t seed = 0, uint64_t stream = 0);
+
+	// An independent stream derived from this one's seed and stream id.
+	// Does not depend on (or advance) this stream's position.
+	RandomStream substream(uint64_t id) const;
+
+	uint64_t getSeed() const { return seed; }
+	uint64_t getStream() const { return stream; }
+
+	// Index of the next 32-bit value to be returned
+	uint64_t tell() const { return index; }
+	void seek(uint64_t i) { index = i; }
+
+	uint32_t nextU32();
+
+	// Uniform in [0, 1)
+	float nextFloat();
+
+	// Uniform in [l, h)
+	float uniform(float l, float h);
+
+	// Uniform integer in [l, h], both ends inclusive
+	int uniformInt(int l, int h);
+
+	// Uniform in a disk / ball of the given radius. Always consume exactly
+	// two / three values so batches stay aligned.
+	glm::vec2 diskRand(float radius);
+	glm::vec3 ballRand(float radius);
+
+	// Fills out[0..n) with uniform values in [l, h), n consecutive values
+	// of the stream.
+	void fill(float *out, size_t n, float l, float h);
+	void fill(uint32_t *out, size_t n);
+
+	// The 4 values of counter block `block` of the given key/stream
+	static void block(uint64_t seed, uint64_t stream, uint64_t block, uint32_t out[4]);
+
+private:
+
+	uint64_t seed;
+	uint64_t stream;
+	uint64_t index = 0;
+
+	uint64_t cachedBlock = ~0ull;
+	uint32_t cache[4];
+
+};
+
+#endif // LAB471_RANDOM_H_INCLUDED
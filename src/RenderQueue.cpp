@@ -0,0 +1,210 @@
+#include "RenderQueue.h"
+#include <cstring>
+#include <algorithm>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Program.h"
+#include "Shape.h"
+#include "Texture.h"
+
+using namespace std;
+
+namespace
+{
+
+const int DepthBits = 24;
+const int MeshBits = 14;
+const int MaterialBits = 6;
+const int TextureBits = 10;
+const int ProgramBits = 6;
+const int PassBits = 4;
+
+// lookup of the "Texture0" uniform is deferred until a textured draw needs it
+const GLint Unknown = -2;
+
+uint64_t field(uint64_t value, int bits, int shift)
+{
+	return (value & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+// Non-negative floats order like their bit patterns, keep the top bits
+uint32_t depthBits(float depth)
+{
+	depth = std::max(depth, 0.0f);
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (32 - DepthBits);
+}
+
+}
+
+int RenderQueue::addProgram(const shared_ptr<Program> &program)
+{
+	ProgramSlot slot;
+	slot.program = program;
+	slot.M = program->getUniform("M");
+	slot.texture = Unknown;
+	programs.push_back(slot);
+	return (int)programs.size() - 1;
+}
+
+int RenderQueue::textureIndex(Texture *texture)
+{
+	if (!texture)
+	{
+		return 0;
+	}
+	map<const Texture *, int>::iterator i = textures.find(texture);
+	if (i != textures.end())
+	{
+		return i->second;
+	}
+	int index = (int)textures.size() + 1;
+	textures[texture] = index;
+	return index;
+}
+
+int RenderQueue::shapeIndex(Shape *shape)
+{
+	map<const Shape *, int>::iterator i = shapes.find(shape);
+	if (i != shapes.end())
+	{
+		return i->second;
+	}
+	int index = (int)shapes.size();
+	shapes[shape] = index;
+	return index;
+}
+
+void RenderQueue::clear()
+{
+	draws.clear();
+	keys.clear();
+}
+
+void RenderQueue::submit(int pass, int program, Texture *texture, int material, Shape *shape, const glm::mat4 &M, float depth)
+{
+	submit(pass, program, texture, material, shape, nullptr, M, depth);
+}
+
+void RenderQueue::submit(int pass, int program, Texture *texture, int material, const vector<shared_ptr<Shape> > &parts, const glm::mat4 &M, float depth)
+{
+	if (!parts.empty())
+	{
+		submit(pass, program, texture, material, parts[0].get(), &parts, M, depth);
+	}
+}
+
+void RenderQueue::submit(int pass, int program, Texture *texture, int material, Shape *shape, const vector<shared_ptr<Shape> > *parts, const glm::mat4 &M, float depth)
+{
+	RadixSort::Entry e;
+	e.key = field(pass, PassBits, 64 - PassBits)
+		| field(program, ProgramBits, 64 - PassBits - ProgramBits)
+		| field(textureIndex(texture), TextureBits, DepthBits + MeshBits + MaterialBits)
+		| field(material + 1, MaterialBits, DepthBits + MeshBits)
+		| field(shapeIndex(shape), MeshBits, DepthBits)
+		| field(depthBits(depth), DepthBits, 0);
+	e.index = (uint32_t)draws.size();
+	keys.push_back(e);
+
+	Draw d;
+	d.program = program;
+	d.texture = texture;
+	d.material = material;
+	d.shape = shape;
+	d.parts = parts;
+	d.M = M;
+	draws.push_back(d);
+}
+
+void RenderQueue::execute(const MaterialFunc &setMaterial)
+{
+	RadixSort::sort(keys, scratch);
+
+	numPrograms = numTextures = numMaterials = numVertexArrays = 0;
+	MeshPool *bound = nullptr;
+	int program = -1;
+	Texture *texture = nullptr;
+	int material = -1;
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		const Draw &d = draws[keys[i].index];
+		ProgramSlot &slot = programs[d.program];
+		if (d.program != program)
+		{
+			slot.program->bind();
+			program = d.program;
+			// samplers and materials are program uniforms
+			texture = nullptr;
+			material = -1;
+			// and vertex arrays depend on the program's attribute locations
+			bound = nullptr;
+			numPrograms++;
+		}
+		if (d.texture && d.texture != texture)
+		{
+			if (slot.texture == Unknown)
+			{
+				slot.texture = slot.program->getUniform("Texture0");
+			}
+			d.texture->bind(slot.texture);
+			texture = d.texture;
+			numTextures++;
+		}
+		if (d.material >= 0 && d.material != material)
+		{
+			setMaterial(slot.program, d.material);
+			material = d.material;
+			numMaterials++;
+		}
+		glUniformMatrix4fv(slot.M, 1, GL_FALSE, glm::value_ptr(d.M));
+		drawParts(d, slot, bound);
+	}
+	// later draws outside the queue mustn't change the pool's vertex array
+	if (bound != nullptr)
+	{
+		glBindVertexArray(0);
+	}
+	if (program >= 0)
+	{
+		programs[program].program->unbind();
+	}
+}
+
+void RenderQueue::drawParts(const Draw &d, const ProgramSlot &slot, MeshPool *&bound)
+{
+	MeshPool *pool = d.shape->pooled();
+	size_t count = d.parts ? d.parts->size() : 1;
+	ranges.clear();
+	for (size_t i = 0; i < count && pool; i++)
+	{
+		Shape *part = d.parts ? (*d.parts)[i].get() : d.shape;
+		if (part->pooled() != pool)
+		{
+			pool = nullptr;
+		}
+		else
+		{
+			ranges.push_back(&part->poolRange());
+		}
+	}
+
+	if (!pool)
+	{
+		// binds vertex arrays of its own
+		for (size_t i = 0; i < count; i++)
+		{
+			(d.parts ? (*d.parts)[i].get() : d.shape)->draw(slot.program);
+		}
+		bound = nullptr;
+		return;
+	}
+	if (bound != pool)
+	{
+		pool->bind(*slot.program);
+		bound = pool;
+		numVertexArrays++;
+	}
+	pool->drawMulti(ranges.data(), (int)ranges.size());
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef LAB471_RENDERQUEUE_H_INCLUDED
+#define LAB471_RENDERQUEUE_H_INCLUDED
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "MeshPool.h"
+#include "RadixSort.h"
+
+class Program;
+class Shape;
+class Texture;
+
+
+// Collects a view's draws and issues them in an order that keeps state
+// changes down.
+//
+// Every draw is described by a 64 bit key, most significant field first:
+//
+//   pass (4) | program (6) | texture (10) | material (6) | mesh (14) | depth (24)
+//
+// so sorting the keys groups draws by program, then by texture and
+// material, then by mesh, and draws those front to back. execute() binds a
+// program, texture or material only when it differs from the previous
+// draw's. Programs are registered once and referred to by index; textures
+// and meshes get their index on first use.
+//
+// Meshes that live in a MeshPool are drawn without switching vertex arrays
+// until the program changes, and the parts of a model submitted together
+// go out as one multi-draw.
+class RenderQueue
+{
+
+public:
+
+	// Sets the material uniforms of a program, like SetMaterial in main
+	typedef std::function<void(const std::shared_ptr<Program> &, int)> MaterialFunc;
+
+	// Index of a program draws can be submitted with. Draws need the program
+	// to have an "M" uniform, and a "Texture0" one if they are textured.
+	int addProgram(const std::shared_ptr<Program> &program);
+
+	void clear();
+
+	// pass orders groups of draws (lower first), texture may be null and
+	// material -1 if the draw uses neither. depth is the distance from the
+	// camera, only its order matters. A model's parts are drawn together, the
+	// vector has to stay alive until execute().
+	void submit(int pass, int program, Texture *texture, int material, Shape *shape, const glm::mat4 &M, float depth);
+	void submit(int pass, int program, Texture *texture, int material, const std::vector<std::shared_ptr<Shape> > &parts, const glm::mat4 &M, float depth);
+
+	// Sorts and issues every submitted draw. The programs' view dependent
+	// uniforms (P, V, lights) have to be set already, they are kept while
+	// other programs are bound.
+	void execute(const MaterialFunc &setMaterial);
+
+	int size() const { return (int)draws.size(); }
+
+	// State changes done by the last execute()
+	int programBinds() const { return numPrograms; }
+	int textureBinds() const { return numTextures; }
+	int materialChanges() const { return numMaterials; }
+	int vertexArrayBinds() const { return numVertexArrays; }
+
+private:
+
+	struct ProgramSlot
+	{
+		std::shared_ptr<Program> program;
+		GLint M = -1;
+		GLint texture = -1;
+	};
+
+	struct Draw
+	{
+		int program;
+		Texture *texture;
+		int material;
+		Shape *shape;
+		const std::vector<std::shared_ptr<Shape> > *parts;
+		glm::mat4 M;
+	};
+
+	void submit(int pass, int program, Texture *texture, int material, Shape *shape, const std::vector<std::shared_ptr<Shape> > *parts, const glm::mat4 &M, float depth);
+	int textureIndex(Texture *texture);
+	int shapeIndex(Shape *shape);
+	void drawParts(const Draw &d, const ProgramSlot &slot, MeshPool *&bound);
+
+	std::vector<ProgramSlot> programs;
+	std::map<const Texture *, int> textures;
+	std::map<const Shape *, int> shapes;
+
+	std::vector<Draw> draws;
+	std::vector<RadixSort::Entry> keys;
+	std::vector<RadixSort::Entry> scratch;
+	std::vector<const MeshPool::Range *> ranges;
+
+	int numPrograms = 0;
+	int numTextures = 0;
+	int numMaterials = 0;
+	int numVertexArrays = 0;
+
+};
+
+#endif // LAB471_RENDERQUEUE_H_INCLUDED
@@ -0,0 +1,377 @@
+#include "RenderTarget.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+
+// bytes per pixel and sample, drivers pad 3 channel formats to 4
+size_t formatBytes(GLenum format)
+{
+	switch (format)
+	{
+		case GL_NONE: return 0;
+		case GL_RGBA16F: return 8;
+		case GL_RGB16F: return 8;
+		case GL_RGBA32F: return 16;
+		default: return 4;
+	}
+}
+
+// glTexImage2D wants a matching client format even without data
+GLenum clientFormat(GLenum format)
+{
+	switch (format)
+	{
+		case GL_RGB8: case GL_RGB: case GL_RGB16F: case GL_R11F_G11F_B10F: return GL_RGB;
+		case GL_R8: case GL_R16F: case GL_R32F: return GL_RED;
+		case GL_RG8: case GL_RG16F: case GL_RG32F: return GL_RG;
+		default: return GL_RGBA;
+	}
+}
+
+}
+
+bool RenderTargetDesc::operator<(const RenderTargetDesc &o) const
+{
+	if (width != o.width) return width < o.width;
+	if (height != o.height) return height < o.height;
+	if (colorFormat != o.colorFormat) return colorFormat < o.colorFormat;
+	if (depthFormat != o.depthFormat) return depthFormat < o.depthFormat;
+	return samples < o.samples;
+}
+
+bool RenderTargetDesc::operator==(const RenderTargetDesc &o) const
+{
+	return !(*this < o) && !(o < *this);
+}
+
+size_t RenderTargetDesc::bytes() const
+{
+	return (size_t)width * height * std::max(samples, 1) * (formatBytes(colorFormat) + formatBytes(depthFormat));
+}
+
+bool RenderTarget::create(const RenderTargetDesc &d)
+{
+	destroy();
+	desc = d;
+	width = d.width;
+	height = d.height;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	if (desc.colorFormat != GL_NONE)
+	{
+		glGenTextures(1, &color);
+		if (desc.samples > 0)
+		{
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, color);
+			glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.colorFormat, width, height, GL_TRUE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, color, 0);
+			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+		}
+		else
+		{
+			glBindTexture(GL_TEXTURE_2D, color);
+			glTexImage2D(GL_TEXTURE_2D, 0, desc.colorFormat, width, height, 0, clientFormat(desc.colorFormat), GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+	else
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+
+	if (desc.depthFormat != GL_NONE)
+	{
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		if (desc.samples > 0)
+		{
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.depthFormat, width, height);
+		}
+		else
+		{
+			glRenderbufferStorage(GL_RENDERBUFFER, desc.depthFormat, width, height);
+		}
+		GLenum attachment = desc.depthFormat == GL_DEPTH24_STENCIL8 || desc.depthFormat == GL_DEPTH32F_STENCIL8 ?
+			GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	}
+
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (!complete)
+	{
+		cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete! (" << width << "x" << height << ")" << endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	return complete;
+}
+
+void RenderTarget::destroy()
+{
+	if (fbo)
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &color);
+		glDeleteRenderbuffers(1, &depth);
+	}
+	fbo = color = depth = 0;
+	width = height = 0;
+}
+
+RenderTargetManager::~RenderTargetManager()
+{
+	for (map<Key, Entry>::iterator i = persistent.begin(); i != persistent.end(); ++i)
+	{
+		i->second.target.destroy();
+	}
+	for (map<RenderTargetDesc, deque<Entry> >::iterator i = transient.begin(); i != transient.end(); ++i)
+	{
+		for (size_t j = 0; j < i->second.size(); j++)
+		{
+			i->second[j].target.destroy();
+		}
+	}
+}
+
+void RenderTargetManager::resize(int w, int h)
+{
+	// minimized windows report 0x0, keep what we have
+	if (w <= 0 || h <= 0 || (w == pendingWidth && h == pendingHeight))
+	{
+		return;
+	}
+	pendingWidth = w;
+	pendingHeight = h;
+	settle = 0;
+}
+
+bool RenderTargetManager::beginFrame()
+{
+	if (pendingWidth == settledWidth && pendingHeight == settledHeight)
+	{
+		return false;
+	}
+	// the first size applies right away, there is nothing to keep yet
+	if (settledWidth > 0 && ++settle < SettleFrames)
+	{
+		return false;
+	}
+	settledWidth = pendingWidth;
+	settledHeight = pendingHeight;
+	return true;
+}
+
+void RenderTargetManager::endFrame(int idleFrames)
+{
+	for (map<Key, Entry>::iterator i = persistent.begin(); i != persistent.end();)
+	{
+		if (++i->second.idle > idleFrames)
+		{
+			i->second.target.destroy();
+			persistent.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	for (map<RenderTargetDesc, deque<Entry> >::iterator i = transient.begin(); i != transient.end();)
+	{
+		deque<Entry> &entries = i->second;
+		for (size_t j = 0; j < entries.size(); j++)
+		{
+			entries[j].busy = false;
+			if (entries[j].target.valid() && ++entries[j].idle > idleFrames)
+			{
+				entries[j].target.destroy();
+			}
+		}
+		while (!entries.empty() && !entries.back().target.valid())
+		{
+			entries.pop_back();
+		}
+		if (entries.empty())
+		{
+			transient.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+RenderTarget &RenderTargetManager::acquire(const RenderTargetDesc &desc, int slot)
+{
+	Entry &e = persistent[Key(desc, slot)];
+	if (!e.target.valid())
+	{
+		e.target.create(desc);
+	}
+	e.idle = 0;
+	return e.target;
+}
+
+RenderTarget *RenderTargetManager::find(const RenderTargetDesc &desc, int slot)
+{
+	map<Key, Entry>::iterator i = persistent.find(Key(desc, slot));
+	if (i == persistent.end())
+	{
+		return nullptr;
+	}
+	i->second.idle = 0;
+	return &i->second.target;
+}
+
+RenderTarget &RenderTargetManager::acquireTransient(const RenderTargetDesc &desc)
+{
+	deque<Entry> &entries = transient[desc];
+	size_t j = 0;
+	while (j < entries.size() && entries[j].busy)
+	{
+		j++;
+	}
+	if (j == entries.size())
+	{
+		entries.push_back(Entry());
+	}
+	Entry &e = entries[j];
+	if (!e.target.valid())
+	{
+		e.target.create(desc);
+	}
+	e.busy = true;
+	e.idle = 0;
+	return e.target;
+}
+
+void RenderTargetManager::release(const RenderTarget &target)
+{
+	map<RenderTargetDesc, deque<Entry> >::iterator i = transient.find(target.desc);
+	if (i == transient.end())
+	{
+		return;
+	}
+	for (size_t j = 0; j < i->second.size(); j++)
+	{
+		if (&i->second[j].target == &target)
+		{
+			i->second[j].busy = false;
+		}
+	}
+}
+
+void RenderTargetManager::evict(const RenderTargetDesc &desc)
+{
+	for (map<Key, Entry>::iterator i = persistent.begin(); i != persistent.end();)
+	{
+		if (i->first.first == desc)
+		{
+			i->second.target.destroy();
+			persistent.erase(i++);
+		}
+		else
+		{
+			++i;
+		}
+	}
+	map<RenderTargetDesc, deque<Entry> >::iterator t = transient.find(desc);
+	if (t != transient.end())
+	{
+		for (size_t j = 0; j < t->second.size(); j++)
+		{
+			t->second[j].target.destroy();
+		}
+		transient.erase(t);
+	}
+}
+
+size_t RenderTargetManager::bytes() const
+{
+	size_t total = 0;
+	for (map<Key, Entry>::const_iterator i = persistent.begin(); i != persistent.end(); ++i)
+	{
+		total += i->second.target.bytes();
+	}
+	for (map<RenderTargetDesc, deque<Entry> >::const_iterator i = transient.begin(); i != transient.end(); ++i)
+	{
+		for (size_t j = 0; j < i->second.size(); j++)
+		{
+			total += i->second[j].target.bytes();
+		}
+	}
+	return total;
+}
+
+int RenderTargetManager::count() const
+{
+	int n = (int)persistent.size();
+	for (map<RenderTargetDesc, deque<Entry> >::const_iterator i = transient.begin(); i != transient.end(); ++i)
+	{
+		for (size_t j = 0; j < i->second.size(); j++)
+		{
+			n += i->second[j].target.valid();
+		}
+	}
+	return n;
+}
+
+void RenderTargetPool::configure(int maxW, int minW, float a)
+{
+	if (maxW == maxWidth && minW == minWidth && a == aspect)
+	{
+		return;
+	}
+	maxWidth = maxW;
+	minWidth = std::min(minW, maxW);
+	aspect = a;
+
+	vector<RenderTargetDesc> old;
+	old.swap(tiers);
+	for (int w = maxWidth; w >= minWidth && w > 0; w /= 2)
+	{
+		tiers.push_back(RenderTargetDesc(w, std::max(1, (int)(w / aspect))));
+	}
+	reverse(tiers.begin(), tiers.end());
+
+	for (size_t i = 0; i < old.size(); i++)
+	{
+		if (find_if(tiers.begin(), tiers.end(), [&](const RenderTargetDesc &d) { return d == old[i]; }) == tiers.end())
+		{
+			targets.evict(old[i]);
+		}
+	}
+}
+
+int RenderTargetPool::tierFor(int width) const
+{
+	for (size_t i = 0; i < tiers.size(); i++)
+	{
+		if (tiers[i].width >= width)
+		{
+			return (int)i;
+		}
+	}
+	return (int)tiers.size() - 1;
+}
+
+RenderTarget *RenderTargetPool::find(int tier, int slot)
+{
+	if (tier < 0 || tier >= (int)tiers.size())
+	{
+		return nullptr;
+	}
+	return targets.find(tiers[tier], slot);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#ifndef LAB471_RENDERTARGET_H_INCLUDED
+#define LAB471_RENDERTARGET_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+
+// What a render target is: its size, the internal format of its color
+// texture and depth renderbuffer (GL_NONE to leave one out) and its sample
+// count (0 for a plain texture)
+struct RenderTargetDesc
+{
+	int width = 0;
+	int height = 0;
+	GLenum colorFormat = GL_RGB8;
+	GLenum depthFormat = GL_DEPTH24_STENCIL8;
+	int samples = 0;
+
+	RenderTargetDesc() {}
+	RenderTargetDesc(int w, int h, GLenum color = GL_RGB8, GLenum depth = GL_DEPTH24_STENCIL8, int s = 0) :
+		width(w), height(h), colorFormat(color), depthFormat(depth), samples(s) {}
+
+	bool operator<(const RenderTargetDesc &o) const;
+	bool operator==(const RenderTargetDesc &o) const;
+	size_t bytes() const;
+};
+
+// An offscreen framebuffer with a color texture and a depth/stencil
+// renderbuffer. Allocated by RenderTargetManager, don't create() or
+// destroy() targets obtained from it.
+struct RenderTarget
+{
+	GLuint fbo = 0;
+	GLuint color = 0;
+	GLuint depth = 0;
+	int width = 0;
+	int height = 0;
+	RenderTargetDesc desc;
+
+	bool create(const RenderTargetDesc &d);
+	void destroy();
+	bool valid() const { return fbo != 0; }
+	size_t bytes() const { return valid() ? desc.bytes() : 0; }
+};
+
+// Owns every offscreen framebuffer, texture and renderbuffer.
+//
+// Targets are looked up by descriptor and allocated on first use. Window
+// size changes reported through resize() only become visible in width()
+// and height() once the size has stopped changing for a few frames, so
+// dragging the window doesn't reallocate screen sized targets every frame;
+// until then passes keep rendering at the old size.
+//
+// Persistent targets keep their content across frames. Transient targets
+// only live until they are released or the frame ends, and a released
+// transient is handed to the next request for the same descriptor, so
+// passes whose lifetimes don't overlap share memory.
+class RenderTargetManager
+{
+
+public:
+
+	static const int SettleFrames = 10;
+
+	~RenderTargetManager();
+
+	// Call with the framebuffer size whenever it may have changed
+	void resize(int width, int height);
+
+	// Applies a settled size change. Returns true if width()/height() changed.
+	bool beginFrame();
+
+	// Ends all transient lifetimes and frees targets that haven't been used
+	// for `idleFrames` frames
+	void endFrame(int idleFrames = 300);
+
+	int width() const { return settledWidth; }
+	int height() const { return settledHeight; }
+
+	// The persistent target for desc in `slot`, allocated if needed.
+	// References stay valid until the target is freed or evicted.
+	RenderTarget &acquire(const RenderTargetDesc &desc, int slot = 0);
+
+	// The persistent target for desc in `slot` if it is allocated, nullptr
+	// otherwise. Counts as a use like acquire().
+	RenderTarget *find(const RenderTargetDesc &desc, int slot = 0);
+
+	// A transient target nobody else holds this frame
+	RenderTarget &acquireTransient(const RenderTargetDesc &desc);
+	void release(const RenderTarget &target);
+
+	// Frees every target with this descriptor right away
+	void evict(const RenderTargetDesc &desc);
+
+	// GPU memory and number of targets currently allocated
+	size_t bytes() const;
+	int count() const;
+
+private:
+
+	struct Entry
+	{
+		RenderTarget target;
+		int idle = 0;
+		bool busy = false;
+	};
+
+	typedef std::pair<RenderTargetDesc, int> Key;
+
+	// std::map and std::deque don't move their elements on insertion
+	std::map<Key, Entry> persistent;
+	std::map<RenderTargetDesc, std::deque<Entry> > transient;
+
+	int settledWidth = 0;
+	int settledHeight = 0;
+	int pendingWidth = 0;
+	int pendingHeight = 0;
+	int settle = 0;
+
+};
+
+// A small set of pre-sized targets ("tiers"), each twice the width and
+// height of the previous one, allocated through a RenderTargetManager.
+// Each tier has any number of persistent slots so several users can hold a
+// target of the same size at once.
+class RenderTargetPool
+{
+
+public:
+
+	explicit RenderTargetPool(RenderTargetManager &targets) : targets(targets) {}
+
+	// Tier sizes: the largest tier is maxWidth wide, each smaller tier halves
+	// it, never going below minWidth. Heights follow the aspect ratio. Targets
+	// of sizes that are no longer tiers are freed.
+	void configure(int maxWidth, int minWidth, float aspect);
+
+	int tierCount() const { return (int)tiers.size(); }
+	int tierWidth(int tier) const { return tiers[tier].width; }
+	int tierHeight(int tier) const { return tiers[tier].height; }
+
+	// Smallest tier at least `width` wide (the largest if none is)
+	int tierFor(int width) const;
+
+	// See RenderTargetManager
+	RenderTarget &acquire(int tier, int slot = 0) { return targets.acquire(tiers[tier], slot); }
+	RenderTarget *find(int tier, int slot);
+	RenderTarget &acquireTransient(int tier) { return targets.acquireTransient(tiers[tier]); }
+	void release(const RenderTarget &target) { targets.release(target); }
+
+private:
+
+	RenderTargetManager &targets;
+	std::vector<RenderTargetDesc> tiers;
+	int maxWidth = 0;
+	int minWidth = 0;
+	float aspect = 0;
+
+};
+
+#endif // LAB471_RENDERTARGET_H_INCLUDED
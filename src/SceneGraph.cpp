@@ -0,0 +1,95 @@
+#include "SceneGraph.h"
+
+#include <cassert>
+
+using namespace std;
+using namespace glm;
+
+SceneGraph::Node SceneGraph::add(Node parent, const Transform &local)
+{
+	assert(parent == None || (flags[parent] & ALIVE));
+	// a free slot only does if it comes after the parent
+	Node n = None;
+	for (size_t i = 0; i < freeSlots.size(); i++)
+	{
+		if (freeSlots[i] > parent)
+		{
+			n = freeSlots[i];
+			freeSlots[i] = freeSlots.back();
+			freeSlots.pop_back();
+			break;
+		}
+	}
+	if (n == None)
+	{
+		n = (Node)parents.size();
+		parents.push_back(parent);
+		locals.push_back(local);
+		worlds.push_back(mat4(1.0f));
+		flags.push_back(ALIVE | DIRTY);
+		stamps.push_back(0);
+		return n;
+	}
+	parents[n] = parent;
+	locals[n] = local;
+	flags[n] = ALIVE | DIRTY;
+	stamps[n] = 0;
+	return n;
+}
+
+void SceneGraph::remove(Node n)
+{
+	assert(flags[n] & ALIVE);
+	flags[n] = 0;
+	freeSlots.push_back(n);
+	// anything alive below a dead parent was under n
+	for (size_t i = n + 1; i < parents.size(); i++)
+	{
+		if ((flags[i] & ALIVE) && parents[i] != None && !(flags[parents[i]] & ALIVE))
+		{
+			flags[i] = 0;
+			freeSlots.push_back((Node)i);
+		}
+	}
+}
+
+void SceneGraph::setLocal(Node n, const Transform &local)
+{
+	// setting the same transform again leaves the subtree clean
+	Transform &old = locals[n];
+	if (old.translation == local.translation && old.rotation == local.rotation && old.scale == local.scale)
+	{
+		return;
+	}
+	old = local;
+	flags[n] |= DIRTY;
+}
+
+void SceneGraph::update()
+{
+	updates++;
+	updated = 0;
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		if (!(flags[i] & ALIVE))
+		{
+			continue;
+		}
+		Node parent = parents[i];
+		if (!(flags[i] & DIRTY) && (parent == None || stamps[parent] != updates))
+		{
+			continue;
+		}
+		if (parent == None)
+		{
+			worlds[i] = locals[i].matrix();
+		}
+		else
+		{
+			MatrixMath::multiply(worlds[parent], locals[i].matrix(), worlds[i]);
+		}
+		flags[i] &= ~DIRTY;
+		stamps[i] = updates;
+		updated++;
+	}
+}
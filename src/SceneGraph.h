@@ -0,0 +1,63 @@
+#pragma once
+#ifndef LAB471_SCENEGRAPH_H_INCLUDED
+#define LAB471_SCENEGRAPH_H_INCLUDED
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Transform.h"
+
+
+// Flat transform hierarchy: per node a parent index, a local transform and
+// the cached world matrix.
+//
+// A child always sits after its parent in the arrays, so update() is one
+// pass in index order. It only recomputes nodes whose local transform
+// changed since the last update, or whose parent was recomputed in this
+// one; subtrees nothing touched keep their world matrices as they are.
+// Setting a node to the transform it already has doesn't count.
+class SceneGraph
+{
+
+public:
+
+	typedef int Node;
+	static const Node None = -1;
+
+	// New node under parent, None for a root
+	Node add(Node parent, const Transform &local = Transform());
+
+	// Removes n and everything below it, their slots get reused
+	void remove(Node n);
+
+	void setLocal(Node n, const Transform &local);
+	const Transform &local(Node n) const { return locals[n]; }
+
+	// As of the last update()
+	const glm::mat4 &world(Node n) const { return worlds[n]; }
+	glm::vec3 worldPosition(Node n) const { return glm::vec3(worlds[n][3]); }
+
+	void update();
+
+	int size() const { return (int)parents.size() - (int)freeSlots.size(); }
+	// nodes the last update() recomputed
+	int updatedCount() const { return updated; }
+
+private:
+
+	enum Flags { ALIVE = 1, DIRTY = 2 };
+
+	std::vector<Node> parents;
+	std::vector<Transform> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned char> flags;
+	// update() that last recomputed the node, children compare against it
+	std::vector<unsigned> stamps;
+	std::vector<Node> freeSlots;
+	unsigned updates = 1;
+	int updated = 0;
+
+};
+
+#endif // LAB471_SCENEGRAPH_H_INCLUDED
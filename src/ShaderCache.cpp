@@ -0,0 +1,223 @@
+#include "ShaderCache.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <GLFW/glfw3.h>
+
+using namespace std;
+
+namespace
+{
+
+// not in our glad, which stops at 3.3 core
+const GLenum PROGRAM_BINARY_RETRIEVABLE_HINT = 0x8257;
+const GLenum PROGRAM_BINARY_LENGTH = 0x8741;
+const GLenum NUM_PROGRAM_BINARY_FORMATS = 0x87FE;
+const GLenum COMPLETION_STATUS_KHR = 0x91B1;
+
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+GetProgramBinaryProc getProgramBinary = nullptr;
+ProgramBinaryProc programBinary = nullptr;
+ProgramParameteriProc programParameteri = nullptr;
+bool parallel = false;
+string directory;
+string driver;
+
+const uint32_t Magic = 0x4e494247; // "GBIN"
+
+bool hasExtension(const char *name)
+{
+	GLint n = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+	for (GLint i = 0; i < n; i++)
+	{
+		const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if (ext && strcmp(ext, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+string glString(GLenum name)
+{
+	const char *s = (const char *)glGetString(name);
+	return s ? s : "";
+}
+
+// FNV-1a
+uint64_t fnv1a(const string &s, uint64_t h = 14695981039346656037ull)
+{
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+string path(const string &key)
+{
+	return directory + "/" + key + ".glbin";
+}
+
+}
+
+namespace ShaderCache
+{
+
+void init(const string &dir)
+{
+	getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+	programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+	programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+	GLint formats = 0;
+	if (getProgramBinary && programBinary && programParameteri)
+	{
+		glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+	// some drivers export the functions but can't produce any binary
+	if (formats <= 0)
+	{
+		getProgramBinary = nullptr;
+		programBinary = nullptr;
+	}
+
+	directory = dir;
+	if (enabled())
+	{
+#ifdef _WIN32
+		_mkdir(dir.c_str());
+#else
+		mkdir(dir.c_str(), 0755);
+#endif
+	}
+	// binaries only load on the exact driver that wrote them
+	driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+	MaxShaderCompilerThreadsProc threads = nullptr;
+	if (hasExtension("GL_KHR_parallel_shader_compile"))
+	{
+		threads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	}
+	else if (hasExtension("GL_ARB_parallel_shader_compile"))
+	{
+		threads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+	}
+	if (threads)
+	{
+		// as many as the driver likes
+		threads(0xFFFFFFFF);
+		parallel = true;
+	}
+}
+
+bool enabled()
+{
+	return programBinary && !directory.empty();
+}
+
+bool parallelCompile()
+{
+	return parallel;
+}
+
+string key(const string &vertexSource, const string &fragmentSource)
+{
+	uint64_t h = fnv1a(driver);
+	h = fnv1a(vertexSource, h);
+	h = fnv1a(string(1, '\0'), h);
+	h = fnv1a(fragmentSource, h);
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)h);
+	return name;
+}
+
+bool load(const string &key, GLuint pid)
+{
+	if (!enabled())
+	{
+		return false;
+	}
+	ifstream in(path(key).c_str(), ios::binary);
+	uint32_t magic = 0, format = 0, length = 0;
+	in.read((char *)&magic, sizeof(magic));
+	in.read((char *)&format, sizeof(format));
+	in.read((char *)&length, sizeof(length));
+	if (!in || magic != Magic || length == 0)
+	{
+		return false;
+	}
+	vector<char> binary(length);
+	in.read(binary.data(), length);
+	if (!in)
+	{
+		return false;
+	}
+	programBinary(pid, format, binary.data(), (GLsizei)length);
+	// a driver update invalidates binaries, we compile again then
+	GLint ok = 0;
+	glGetProgramiv(pid, GL_LINK_STATUS, &ok);
+	return ok != 0;
+}
+
+void prepare(GLuint pid)
+{
+	if (enabled())
+	{
+		programParameteri(pid, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+void store(const string &key, GLuint pid)
+{
+	if (!enabled())
+	{
+		return;
+	}
+	GLint length = 0;
+	glGetProgramiv(pid, PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+	vector<char> binary(length);
+	GLenum format = 0;
+	getProgramBinary(pid, length, &length, &format, binary.data());
+
+	ofstream out(path(key).c_str(), ios::binary);
+	uint32_t header[3] = { Magic, format, (uint32_t)length };
+	out.write((const char *)header, sizeof(header));
+	out.write(binary.data(), length);
+	if (!out)
+	{
+		cerr << "Could not write shader cache '" << path(key) << "'" << endl;
+	}
+}
+
+bool completed(GLuint pid)
+{
+	if (!parallel)
+	{
+		return true;
+	}
+	GLint done = 0;
+	glGetProgramiv(pid, COMPLETION_STATUS_KHR, &done);
+	return done != 0;
+}
+
+}
@@ -0,0 +1,41 @@
+//
+// On-disk cache of linked program binaries, and the driver's parallel
+// shader compilation where it has one.
+//
+
+#pragma once
+#ifndef LAB471_SHADERCACHE_H_INCLUDED
+#define LAB471_SHADERCACHE_H_INCLUDED
+
+#include <string>
+
+#include <glad/glad.h>
+
+
+namespace ShaderCache
+{
+	// Loads the entry points glad doesn't know (GL 4.1 / ARB_get_program_binary,
+	// KHR_parallel_shader_compile). Call once with a current context. Binaries
+	// are kept in dir, an empty dir turns the cache off.
+	void init(const std::string &dir);
+
+	bool enabled();
+	bool parallelCompile();
+
+	// Identifies a program: hash of its sources and of the driver that built it
+	std::string key(const std::string &vertexSource, const std::string &fragmentSource);
+
+	// Links pid from the binary stored under key. False if there is none or
+	// the driver doesn't take it any more, pid is untouched then.
+	bool load(const std::string &key, GLuint pid);
+
+	// Call before glLinkProgram on programs that will be stored
+	void prepare(GLuint pid);
+	void store(const std::string &key, GLuint pid);
+
+	// Whether compiling and linking pid is done, without waiting for it.
+	// Always true without parallel compilation.
+	bool completed(GLuint pid);
+}
+
+#endif // LAB471_SHADERCACHE_H_INCLUDED
@@ -0,0 +1,80 @@
+#include "ShaderVariants.h"
+#include <sstream>
+
+using namespace std;
+
+void ShaderVariants::setShaderNames(const string &v, const string &f)
+{
+	vShaderName = v;
+	fShaderName = f;
+}
+
+string ShaderVariants::defines(bool textured, int lights)
+{
+	ostringstream s;
+	s << "#define LIGHTS " << lights << "\n";
+	if (textured)
+	{
+		s << "#define TEXTURED\n";
+	}
+	return s.str();
+}
+
+bool ShaderVariants::declares(Requires needs, bool textured, int lights)
+{
+	switch (needs)
+	{
+	case IF_TEXTURED:
+		return textured;
+	case IF_UNTEXTURED:
+		return !textured;
+	case IF_LIT:
+		return lights > 0;
+	default:
+		return true;
+	}
+}
+
+const shared_ptr<Program> &ShaderVariants::add(bool textured, int lights)
+{
+	shared_ptr<Program> &prog = variants[Key(textured, lights)];
+	if (!prog)
+	{
+		prog = make_shared<Program>();
+		prog->setVerbose(true);
+		prog->setShaderNames(vShaderName, fShaderName);
+		prog->setDefines(defines(textured, lights));
+		prog->begin();
+		for (size_t i = 0; i < uniforms.size(); i++)
+		{
+			if (declares(uniforms[i].second, textured, lights))
+			{
+				prog->addUniform(uniforms[i].first);
+			}
+		}
+		for (size_t i = 0; i < attributes.size(); i++)
+		{
+			if (declares(attributes[i].second, textured, lights))
+			{
+				prog->addAttribute(attributes[i].first);
+			}
+		}
+	}
+	return prog;
+}
+
+bool ShaderVariants::finish()
+{
+	bool ok = true;
+	for (map<Key, shared_ptr<Program> >::iterator i = variants.begin(); i != variants.end(); ++i)
+	{
+		ok = i->second->finish() && ok;
+	}
+	return ok;
+}
+
+shared_ptr<Program> ShaderVariants::get(bool textured, int lights) const
+{
+	map<Key, shared_ptr<Program> >::const_iterator i = variants.find(Key(textured, lights));
+	return i == variants.end() ? nullptr : i->second;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef LAB471_SHADERVARIANTS_H_INCLUDED
+#define LAB471_SHADERVARIANTS_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "Program.h"
+
+
+// One shader pair compiled into a Program per combination of the #defines
+// it is written against:
+//
+//   LIGHTS    number of point lights the shaders loop over, 0 for unlit
+//   TEXTURED  defined for variants that sample Texture0
+//
+// Callers pick the smallest variant that does the job per draw, so objects
+// only one light reaches pay for one light.
+class ShaderVariants
+{
+
+public:
+
+	// Which variants declare a uniform or attribute, the others compile it
+	// out and would warn that it can't be bound
+	enum Requires { ALWAYS, IF_TEXTURED, IF_UNTEXTURED, IF_LIT };
+
+	void setShaderNames(const std::string &v, const std::string &f);
+
+	// Registered with the matching variants added afterwards
+	void addUniform(const std::string &name, Requires needs = ALWAYS) { uniforms.push_back(Input(name, needs)); }
+	void addAttribute(const std::string &name, Requires needs = ALWAYS) { attributes.push_back(Input(name, needs)); }
+
+	// Creates the variant and starts compiling it, see Program::begin()
+	const std::shared_ptr<Program> &add(bool textured, int lights);
+
+	// Waits for every variant, false if one of them failed
+	bool finish();
+
+	// nullptr if the variant wasn't added
+	std::shared_ptr<Program> get(bool textured, int lights) const;
+
+	static std::string defines(bool textured, int lights);
+
+private:
+
+	typedef std::pair<bool, int> Key;
+	typedef std::pair<std::string, Requires> Input;
+
+	static bool declares(Requires needs, bool textured, int lights);
+
+	std::string vShaderName;
+	std::string fShaderName;
+	std::vector<Input> uniforms;
+	std::vector<Input> attributes;
+	std::map<Key, std::shared_ptr<Program> > variants;
+
+};
+
+#endif // LAB471_SHADERVARIANTS_H_INCLUDED
@@ -12,7 +12,8 @@ Shape::Shape() :
 	posBufID(0),
 	norBufID(0),
 	texBufID(0), 
-   vaoID(0)
+   vaoID(0),
+	pool(nullptr)
 {
 	min = glm::vec3(0);
 	max = glm::vec3(0);
@@ -98,8 +99,24 @@ void Shape::init()
 	assert(glGetError() == GL_NO_ERROR);
 }
 
+void Shape::init(MeshPool &p)
+{
+	if(norBuf.empty()) {
+		computeNormals();
+	}
+	pool = &p;
+	range = pool->add(posBuf, norBuf, texBuf, eleBuf);
+}
+
 void Shape::draw(const shared_ptr<Program> prog) const
 {
+	if (pool) {
+		pool->bind(*prog);
+		pool->draw(range);
+		glBindVertexArray(0);
+		return;
+	}
+
 	int h_pos, h_nor, h_tex;
 	h_pos = h_nor = h_tex = -1;
 
@@ -8,6 +8,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <tiny_obj_loader/tiny_obj_loader.h>
 
+#include "MeshPool.h"
+
 class Program;
 
 class Shape
@@ -17,11 +19,17 @@ public:
 	virtual ~Shape();
 	void createShape(tinyobj::shape_t & shape);
 	void init();
+	// Puts the geometry in pool instead of buffers of its own, drawable once
+	// the pool is uploaded
+	void init(MeshPool &pool);
 	void measure();
 	void draw(const std::shared_ptr<Program> prog) const;
 	void computeNormals();
 	glm::vec3 min;
 	glm::vec3 max;
+
+	MeshPool *pooled() const { return pool; }
+	const MeshPool::Range &poolRange() const { return range; }
 	
 private:
 	std::vector<unsigned int> eleBuf;
@@ -33,6 +41,8 @@ private:
 	unsigned norBufID;
 	unsigned texBufID;
    unsigned vaoID;
+	MeshPool *pool;
+	MeshPool::Range range;
 };
 
 #endif
@@ -0,0 +1,154 @@
+#pragma once
+#ifndef LAB471_SLOTMAP_H_INCLUDED
+#define LAB471_SLOTMAP_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+
+
+// Unordered storage with stable handles.
+//
+// Values are kept densely in one vector, so iterating is a plain loop over
+// size() values. A handle names a slot, which knows where in the dense array
+// its value is, and a generation that changes every time the slot is
+// emptied, so handles to removed values are detected instead of dangling.
+// Insert and remove are O(1): removing moves the last value into the hole.
+//
+// Removing while iterating by dense index: don't advance past the index
+// just removed, the last value is there now.
+template<class T>
+class SlotMap
+{
+
+public:
+
+	struct Handle
+	{
+		uint32_t slot = ~0u;
+		uint32_t generation = 0;
+
+		bool operator==(const Handle &o) const { return slot == o.slot && generation == o.generation; }
+		bool operator!=(const Handle &o) const { return !(*this == o); }
+	};
+
+	Handle insert(const T &value)
+	{
+		Handle h = allocate();
+		values.push_back(value);
+		return h;
+	}
+
+	Handle insert(T &&value)
+	{
+		Handle h = allocate();
+		values.push_back(std::move(value));
+		return h;
+	}
+
+	// False if h was already removed
+	bool remove(Handle h)
+	{
+		if (!contains(h))
+		{
+			return false;
+		}
+		removeAt(slots[h.slot].dense);
+		return true;
+	}
+
+	// Removes the value at dense index i, the last value takes its place
+	void removeAt(size_t i)
+	{
+		assert(i < values.size());
+		uint32_t slot = owners[i];
+		size_t last = values.size() - 1;
+		if (i != last)
+		{
+			values[i] = std::move(values[last]);
+			owners[i] = owners[last];
+			slots[owners[i]].dense = (uint32_t)i;
+		}
+		values.pop_back();
+		owners.pop_back();
+		slots[slot].generation++;
+		slots[slot].dense = freeHead;
+		freeHead = slot;
+	}
+
+	bool contains(Handle h) const
+	{
+		return h.slot < slots.size() && slots[h.slot].generation == h.generation;
+	}
+
+	// nullptr for a removed value
+	T *get(Handle h) { return contains(h) ? &values[slots[h.slot].dense] : nullptr; }
+	const T *get(Handle h) const { return contains(h) ? &values[slots[h.slot].dense] : nullptr; }
+
+	// Dense access, the order changes as values are removed
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+	T &operator[](size_t i) { return values[i]; }
+	const T &operator[](size_t i) const { return values[i]; }
+	Handle handle(size_t i) const
+	{
+		Handle h;
+		h.slot = owners[i];
+		h.generation = slots[h.slot].generation;
+		return h;
+	}
+
+	typedef typename std::vector<T>::iterator iterator;
+	typedef typename std::vector<T>::const_iterator const_iterator;
+	iterator begin() { return values.begin(); }
+	iterator end() { return values.end(); }
+	const_iterator begin() const { return values.begin(); }
+	const_iterator end() const { return values.end(); }
+
+	void reserve(size_t n)
+	{
+		values.reserve(n);
+		owners.reserve(n);
+		slots.reserve(n);
+	}
+
+private:
+
+	struct Slot
+	{
+		uint32_t dense;      // index into values, or the next free slot
+		uint32_t generation;
+	};
+
+	Handle allocate()
+	{
+		Handle h;
+		if (freeHead != None)
+		{
+			h.slot = freeHead;
+			freeHead = slots[freeHead].dense;
+		}
+		else
+		{
+			h.slot = (uint32_t)slots.size();
+			Slot s;
+			s.generation = 0;
+			slots.push_back(s);
+		}
+		slots[h.slot].dense = (uint32_t)values.size();
+		h.generation = slots[h.slot].generation;
+		owners.push_back(h.slot);
+		return h;
+	}
+
+	static const uint32_t None = ~0u;
+
+	std::vector<T> values;
+	std::vector<uint32_t> owners; // slot of each value
+	std::vector<Slot> slots;
+	uint32_t freeHead = None;
+
+};
+
+#endif // LAB471_SLOTMAP_H_INCLUDED
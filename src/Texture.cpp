@@ -35,28 +35,41 @@ void Texture::init()
 	if((w & (w - 1)) != 0 || (h & (h - 1)) != 0) {
 		// cerr << filename << " must be a power of 2" << endl;
 	}
+	upload(data, w, h, 3);
+	// Free image, since the data is now on the GPU
+	stbi_image_free(data);
+}
+
+void Texture::upload(const unsigned char *data, int w, int h, int ncomps)
+{
 	width = w;
 	height = h;
 
-	// Generate a texture buffer object
-	glGenTextures(1, &tid);
+	// Generate a texture buffer object, the first time
+	bool created = tid == 0;
+	if(created) {
+		glGenTextures(1, &tid);
+	}
 	// Bind the current texture to be the newly generated texture object
 	glBindTexture(GL_TEXTURE_2D, tid);
 	// Load the actual texture data
-	// Base level is 0, number of channels is 3, and border is 0.
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+	// Base level is 0, and border is 0. Rows of odd widths aren't 4 byte aligned.
+	GLenum format = ncomps == 4 ? GL_RGBA : ncomps == 1 ? GL_RED : GL_RGB;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	// Generate image pyramid
 	glGenerateMipmap(GL_TEXTURE_2D);
-	// Set texture wrap modes for the S and T directions
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	// Set filtering mode for magnification and minimification
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	if(created) {
+		// Set texture wrap modes for the S and T directions
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// Set filtering mode for magnification and minimification
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
 	// Unbind
 	glBindTexture(GL_TEXTURE_2D, 0);
-	// Free image, since the data is now on the GPU
-	stbi_image_free(data);
 }
 
 void Texture::setWrapModes(GLint wrapS, GLint wrapT)
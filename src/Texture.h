@@ -12,6 +12,9 @@ public:
 	virtual ~Texture();
 	void setFilename(const std::string &f) { filename = f; }
 	void init();
+	// Replaces the contents with w x h pixels of ncomps 8-bit channels,
+	// rows bottom up. Creates the texture on first use.
+	void upload(const unsigned char *data, int w, int h, int ncomps);
 	void setUnit(GLint u) { unit = u; }
 	GLint getUnit() const { return unit; }
 	void bind(GLint handle);
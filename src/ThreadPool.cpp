@@ -0,0 +1,97 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) : next(0)
+{
+	if (threads <= 0)
+	{
+		threads = max(1, (int)thread::hardware_concurrency());
+	}
+	for (int i = 1; i < threads; i++)
+	{
+		workers.push_back(thread(&ThreadPool::work, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(sync);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+void ThreadPool::dispatch(int n, Run r, void *c)
+{
+	if (n <= 0)
+	{
+		return;
+	}
+	if (workers.empty() || n == 1)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			r(c, i);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(sync);
+		run = r;
+		closure = c;
+		count = n;
+		next = 0;
+		batch++;
+		busy = (int)workers.size();
+	}
+	wake.notify_all();
+
+	drain();
+
+	// every task done isn't enough, the workers must also have stopped
+	// looking at this batch before the closure goes away
+	unique_lock<mutex> lock(sync);
+	done.wait(lock, [this] { return busy == 0; });
+}
+
+void ThreadPool::drain()
+{
+	for (int i = next++; i < count; i = next++)
+	{
+		run(closure, i);
+	}
+}
+
+void ThreadPool::work()
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			unique_lock<mutex> lock(sync);
+			wake.wait(lock, [this, seen] { return quit || batch != seen; });
+			if (quit)
+			{
+				return;
+			}
+			seen = batch;
+		}
+
+		drain();
+
+		lock_guard<mutex> lock(sync);
+		if (--busy == 0)
+		{
+			done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,69 @@
+//
+// Worker threads for splitting CPU work of a frame into tasks.
+//
+
+#pragma once
+#ifndef LAB471_THREADPOOL_H_INCLUDED
+#define LAB471_THREADPOOL_H_INCLUDED
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+class ThreadPool
+{
+
+public:
+
+	// 0 threads: one less than the hardware has, the caller is the last one
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// Calls f(i) for i in [0, count) spread over the workers and the calling
+	// thread, returns when all are done. Not reentrant.
+	template<class F>
+	void parallelFor(int count, F &f)
+	{
+		dispatch(count, &invoke<F>, &f);
+	}
+
+	// Including the calling thread
+	int threadCount() const { return (int)workers.size() + 1; }
+
+private:
+
+	typedef void (*Run)(void *closure, int i);
+
+	template<class F>
+	static void invoke(void *closure, int i)
+	{
+		(*static_cast<F *>(closure))(i);
+	}
+
+	void dispatch(int count, Run run, void *closure);
+	void work();
+	void drain();
+
+	std::vector<std::thread> workers;
+	std::mutex sync;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	// the current parallelFor
+	Run run = nullptr;
+	void *closure = nullptr;
+	int count = 0;
+	std::atomic<int> next;
+	unsigned batch = 0;
+	int busy = 0;
+	bool quit = false;
+
+};
+
+#endif // LAB471_THREADPOOL_H_INCLUDED
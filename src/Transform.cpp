@@ -0,0 +1,152 @@
+#include "Transform.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATRIX_MATH_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace glm;
+
+namespace MatrixMath
+{
+
+void multiply(const mat4 &a, const mat4 &b, mat4 &out)
+{
+#ifdef MATRIX_MATH_X86
+	__m128 a0 = _mm_loadu_ps(&a[0][0]);
+	__m128 a1 = _mm_loadu_ps(&a[1][0]);
+	__m128 a2 = _mm_loadu_ps(&a[2][0]);
+	__m128 a3 = _mm_loadu_ps(&a[3][0]);
+	// column j of the result is a times column j of b
+	__m128 r[4];
+	for (int j = 0; j < 4; j++)
+	{
+		r[j] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[j][0])), _mm_mul_ps(a1, _mm_set1_ps(b[j][1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[j][2])), _mm_mul_ps(a3, _mm_set1_ps(b[j][3]))));
+	}
+	for (int j = 0; j < 4; j++)
+	{
+		_mm_storeu_ps(&out[j][0], r[j]);
+	}
+#else
+	out = a * b;
+#endif
+}
+
+void translate(mat4 &m, const vec3 &offset)
+{
+#ifdef MATRIX_MATH_X86
+	__m128 c = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m[0][0]), _mm_set1_ps(offset.x)), _mm_mul_ps(_mm_loadu_ps(&m[1][0]), _mm_set1_ps(offset.y))),
+		_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m[2][0]), _mm_set1_ps(offset.z)), _mm_loadu_ps(&m[3][0])));
+	_mm_storeu_ps(&m[3][0], c);
+#else
+	m[3] = m[0] * offset.x + m[1] * offset.y + m[2] * offset.z + m[3];
+#endif
+}
+
+void scale(mat4 &m, const vec3 &s)
+{
+	m[0] *= s.x;
+	m[1] *= s.y;
+	m[2] *= s.z;
+}
+
+void rotate(mat4 &m, const mat3 &r)
+{
+#ifdef MATRIX_MATH_X86
+	__m128 m0 = _mm_loadu_ps(&m[0][0]);
+	__m128 m1 = _mm_loadu_ps(&m[1][0]);
+	__m128 m2 = _mm_loadu_ps(&m[2][0]);
+	__m128 c[3];
+	for (int j = 0; j < 3; j++)
+	{
+		c[j] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, _mm_set1_ps(r[j][0])), _mm_mul_ps(m1, _mm_set1_ps(r[j][1]))),
+			_mm_mul_ps(m2, _mm_set1_ps(r[j][2])));
+	}
+	for (int j = 0; j < 3; j++)
+	{
+		_mm_storeu_ps(&m[j][0], c[j]);
+	}
+#else
+	vec4 c[3];
+	for (int j = 0; j < 3; j++)
+	{
+		c[j] = m[0] * r[j][0] + m[1] * r[j][1] + m[2] * r[j][2];
+	}
+	m[0] = c[0];
+	m[1] = c[1];
+	m[2] = c[2];
+#endif
+}
+
+mat3 rotation(float angle, const vec3 &axis)
+{
+	float c = cos(angle);
+	float s = sin(angle);
+	vec3 a = normalize(axis);
+	vec3 t = (1.0f - c) * a;
+	mat3 r;
+	r[0] = vec3(c + t.x * a.x, t.x * a.y + s * a.z, t.x * a.z - s * a.y);
+	r[1] = vec3(t.y * a.x - s * a.z, c + t.y * a.y, t.y * a.z + s * a.x);
+	r[2] = vec3(t.z * a.x + s * a.y, t.z * a.y - s * a.x, c + t.z * a.z);
+	return r;
+}
+
+mat3 rotation(const quat &q)
+{
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	mat3 r;
+	r[0] = vec3(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy));
+	r[1] = vec3(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx));
+	r[2] = vec3(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy));
+	return r;
+}
+
+}
+
+Transform Transform::translate(const vec3 &offset)
+{
+	Transform t;
+	t.translation = offset;
+	return t;
+}
+
+Transform Transform::rotate(float angle, const vec3 &axis)
+{
+	Transform t;
+	t.rotation = angleAxis(angle, normalize(axis));
+	return t;
+}
+
+Transform Transform::scaling(const vec3 &s)
+{
+	Transform t;
+	t.scale = s;
+	return t;
+}
+
+Transform Transform::operator*(const Transform &o) const
+{
+	Transform t;
+	t.translation = translation + rotation * (scale * o.translation);
+	t.rotation = rotation * o.rotation;
+	t.scale = scale * o.scale;
+	return t;
+}
+
+mat4 Transform::matrix() const
+{
+	mat3 r = MatrixMath::rotation(rotation);
+	mat4 m;
+	m[0] = vec4(r[0] * scale.x, 0.0f);
+	m[1] = vec4(r[1] * scale.y, 0.0f);
+	m[2] = vec4(r[2] * scale.z, 0.0f);
+	m[3] = vec4(translation, 1.0f);
+	return m;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef LAB471_TRANSFORM_H_INCLUDED
+#define LAB471_TRANSFORM_H_INCLUDED
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+
+// 4x4 transform math on glm matrices, with SSE where available. Matrices
+// are column major as in glm, m * T means T is applied first.
+namespace MatrixMath
+{
+	// out = a * b, out may be a or b
+	void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out);
+
+	// m = m * T, m * S and m * R without building the right hand matrix.
+	// Only the columns that change are touched.
+	void translate(glm::mat4 &m, const glm::vec3 &offset);
+	void scale(glm::mat4 &m, const glm::vec3 &s);
+	void rotate(glm::mat4 &m, const glm::mat3 &r);
+
+	// Rotation by angle (radians) about axis, same as glm::rotate
+	glm::mat3 rotation(float angle, const glm::vec3 &axis);
+	glm::mat3 rotation(const glm::quat &q);
+}
+
+// Placement of an object as translation, rotation and scale: 10 floats
+// instead of 16, composed without any 4x4 multiply. For bulk objects whose
+// transform is rebuilt every frame.
+struct Transform
+{
+	glm::vec3 translation = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+
+	static Transform translate(const glm::vec3 &offset);
+	static Transform rotate(float angle, const glm::vec3 &axis);
+	static Transform scaling(const glm::vec3 &s);
+
+	// This applied after o, like multiplying their matrices. Exact as long
+	// as this transform's scale is uniform, which is all the scene uses.
+	Transform operator*(const Transform &o) const;
+
+	glm::mat4 matrix() const;
+};
+
+#endif // LAB471_TRANSFORM_H_INCLUDED
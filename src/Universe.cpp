@@ -0,0 +1,177 @@
+#include "Universe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "ThreadPool.h"
+
+using namespace std;
+using namespace glm;
+
+namespace
+{
+
+// sectors apart, as the largest difference of coordinates
+int sectorDistance(const ivec3 &a, const ivec3 &b)
+{
+	return max(max(abs(a.x - b.x), abs(a.y - b.y)), abs(a.z - b.z));
+}
+
+bool sameSector(const ivec3 &a, const ivec3 &b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// 21 bits per coordinate, enough to fly for a very long time
+uint64_t sectorKey(const ivec3 &c)
+{
+	const uint64_t mask = (1u << 21) - 1;
+	return ((uint64_t)c.x & mask) << 42 | ((uint64_t)c.y & mask) << 21 | ((uint64_t)c.z & mask);
+}
+
+}
+
+Universe::Universe(const RandomStream &random, ThreadPool *pool) : random(random), pool(pool)
+{
+}
+
+ivec3 Universe::sectorOf(const vec3 &p) const
+{
+	return ivec3((int)floor(p.x / sectorSize), (int)floor(p.y / sectorSize), (int)floor(p.z / sectorSize));
+}
+
+void Universe::update(const vec3 &camera)
+{
+	ivec3 center = sectorOf(camera);
+
+	for (size_t i = 0; i < loaded.size();)
+	{
+		if (sectorDistance(loaded[i]->coords, center) > retireRadius)
+		{
+			spare.push_back(std::move(loaded[i]));
+			loaded[i] = std::move(loaded.back());
+			loaded.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	wanted.clear();
+	for (int x = -loadRadius; x <= loadRadius; x++)
+	{
+		for (int y = -loadRadius; y <= loadRadius; y++)
+		{
+			for (int z = -loadRadius; z <= loadRadius; z++)
+			{
+				ivec3 c(center.x + x, center.y + y, center.z + z);
+				bool present = false;
+				for (size_t i = 0; i < loaded.size() && !present; i++)
+				{
+					present = sameSector(loaded[i]->coords, c);
+				}
+				if (!present)
+				{
+					wanted.push_back(c);
+				}
+			}
+		}
+	}
+	// nearest first, the camera's own sector before anything else
+	sort(wanted.begin(), wanted.end(), [center](const ivec3 &a, const ivec3 &b) {
+		int da = (a.x - center.x) * (a.x - center.x) + (a.y - center.y) * (a.y - center.y) + (a.z - center.z) * (a.z - center.z);
+		int db = (b.x - center.x) * (b.x - center.x) + (b.y - center.y) * (b.y - center.y) + (b.z - center.z) * (b.z - center.z);
+		return da < db;
+	});
+
+	// a batch of sectors per round, one per thread, until the budget is spent
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	int threads = pool ? pool->threadCount() : 1;
+	size_t next = 0;
+	while (next < wanted.size() && chrono::duration<double>(Clock::now() - start).count() < budget)
+	{
+		batch.clear();
+		for (int t = 0; t < threads && next < wanted.size(); t++, next++)
+		{
+			if (spare.empty())
+			{
+				spare.push_back(unique_ptr<Sector>(new Sector()));
+			}
+			loaded.push_back(std::move(spare.back()));
+			spare.pop_back();
+			loaded.back()->coords = wanted[next];
+			batch.push_back(loaded.back().get());
+		}
+		auto generateBatch = [this](int i) {
+			generate(*batch[i]);
+		};
+		if (pool)
+		{
+			pool->parallelFor((int)batch.size(), generateBatch);
+		}
+		else
+		{
+			generateBatch(0);
+		}
+	}
+	wanted.erase(wanted.begin(), wanted.begin() + next);
+}
+
+void Universe::generate(Sector &sector) const
+{
+	sector.bodies.clear();
+	RandomStream r = random.substream(sectorKey(sector.coords));
+	vec3 corner = vec3((float)sector.coords.x, (float)sector.coords.y, (float)sector.coords.z) * sectorSize;
+
+	// about every other sector has a few planets close together
+	if (r.nextFloat() < .5f)
+	{
+		vec3 system = corner + vec3(r.uniform(.2f, .8f), r.uniform(.2f, .8f), r.uniform(.2f, .8f)) * sectorSize;
+		int planets = r.uniformInt(1, 4);
+		for (int i = 0; i < planets; i++)
+		{
+			vec2 p = r.diskRand(60.0f);
+			Body b;
+			b.kind = Body::PLANET;
+			b.position = system + vec3(p.x, r.uniform(-3, 3), p.y);
+			b.scale = r.uniform(.008f, .02f);
+			b.spin = r.uniform(0.5f, 1.5f) * ((.2f < r.nextFloat()) ? 1 : -1);
+			b.material = r.uniformInt(0, 17);
+			sector.bodies.push_back(b);
+		}
+	}
+	// and most a cloud of asteroids
+	if (r.nextFloat() < .7f)
+	{
+		vec3 cloud = corner + vec3(r.nextFloat(), r.nextFloat(), r.nextFloat()) * sectorSize;
+		int asteroids = r.uniformInt(10, 40);
+		for (int i = 0; i < asteroids; i++)
+		{
+			Body b;
+			b.kind = Body::ASTEROID;
+			b.position = cloud + r.ballRand(40.0f);
+			b.scale = r.uniform(.01f, .0175f);
+			b.spin = r.uniform(1.0f, 1.5f);
+			b.material = 0;
+			sector.bodies.push_back(b);
+		}
+	}
+
+	// the home system has its own
+	for (size_t i = 0; i < sector.bodies.size();)
+	{
+		if (length(sector.bodies[i].position) < clearRadius)
+		{
+			sector.bodies[i] = sector.bodies.back();
+			sector.bodies.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
@@ -0,0 +1,86 @@
+//
+// The universe beyond the home system, generated sector by sector as the
+// camera gets close and dropped again behind it.
+//
+
+#pragma once
+#ifndef LAB471_UNIVERSE_H_INCLUDED
+#define LAB471_UNIVERSE_H_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "Random.h"
+
+class ThreadPool;
+
+
+// Space is a grid of cubic sectors. A sector's contents are a pure function
+// of the seed and its coordinates, so one that is retired and comes back
+// later is generated exactly as before, and nothing has to be kept for the
+// parts of the universe no one is near.
+//
+// update() retires sectors further than retireRadius from the camera's and
+// generates missing ones within loadRadius, nearest first, on the pool's
+// threads. It stops starting new ones once the frame's budget is used up,
+// the rest follow in the next frames.
+class Universe
+{
+
+public:
+
+	struct Body
+	{
+		enum Kind { PLANET, ASTEROID };
+		Kind kind;
+		glm::vec3 position;
+		float scale;
+		float spin;
+		int material;
+	};
+
+	struct Sector
+	{
+		glm::ivec3 coords;
+		std::vector<Body> bodies;
+	};
+
+	Universe(const RandomStream &random, ThreadPool *pool = nullptr);
+
+	void update(const glm::vec3 &camera);
+
+	// Everything generated so far, in no particular order
+	const std::vector<std::unique_ptr<Sector> > &sectors() const { return loaded; }
+	// Sectors within loadRadius still waiting to be generated
+	int pending() const { return (int)wanted.size(); }
+
+	float sectorSize = 400.0f;
+	// in sectors, as the largest difference of coordinates
+	int loadRadius = 1;
+	int retireRadius = 2;
+	// seconds per update() spent generating
+	double budget = 0.002;
+	// the home system fills this sphere, nothing is generated in it
+	float clearRadius = 300.0f;
+
+	glm::ivec3 sectorOf(const glm::vec3 &p) const;
+
+private:
+
+	void generate(Sector &sector) const;
+
+	RandomStream random;
+	ThreadPool *pool;
+
+	std::vector<std::unique_ptr<Sector> > loaded;
+	// retired sectors, their storage is reused
+	std::vector<std::unique_ptr<Sector> > spare;
+	std::vector<glm::ivec3> wanted;
+	std::vector<Sector *> batch;
+
+};
+
+#endif // LAB471_UNIVERSE_H_INCLUDED
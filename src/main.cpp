@@ -2,22 +2,47 @@
 #include <glad/glad.h>
 #include <cmath>
 #include <vector>
+#include <map>
+#include <cstdlib>
+#include <climits>
 
 #include "GLSL.h"
 #include "Program.h"
 #include "Shape.h"
 #include "MatrixStack.h"
+#include "Transform.h"
+#include "SceneGraph.h"
+#include "SlotMap.h"
+#include "ThreadPool.h"
+#include "NBody.h"
+#include "Universe.h"
+#include "PoissonDisk.h"
 #include "WindowManager.h"
 #include "Texture.h"
-#include "stb_image.h"
 #include "particleSys.h"
+#include "MicroBench.h"
+#include "Random.h"
+#include "InputRecorder.h"
+#include "Benchmark.h"
+#include "Profiler.h"
+#include "RenderTarget.h"
+#include "Portal.h"
+#include "Bloom.h"
+#include "FrameGraph.h"
+#include "RenderQueue.h"
+#include "MeshPool.h"
+#include "ShaderCache.h"
+#include "ShaderVariants.h"
+#include "FrameArena.h"
+#include "AllocationTracker.h"
+#include "LightClusters.h"
+#include "AssetLoader.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader/tiny_obj_loader.h>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/random.hpp>
 
 using namespace std;
 using namespace glm;
@@ -49,13 +74,14 @@ public:
 
 	struct Moon {
 		vec3 position;
-		vec3 absolutePosition;
 		int material;
 		float rotationSpeed;
 		float revolutionSpeed;
 
 		vec3 escapeDirection;
 		float speed;
+		// while it orbits a planet
+		SceneGraph::Node node = SceneGraph::None;
 		Moon(vec3 position, int material, float rotationSpeed, float revolutionSpeed) {
 			this->position = position;
 			this->material = material;
@@ -65,9 +91,10 @@ public:
 			speed = 0;
 		}
 
-		void escape(vec3 cog) {
+		void escape(vec3 cog, vec3 worldPosition) {
 			speed = revolutionSpeed/60.0f * length(position);
-			position = absolutePosition;
+			position = worldPosition;
+			node = SceneGraph::None;
 			vec3 centripetal = position - cog;
 			escapeDirection = vec3(centripetal.x * cos(-PI/2) - centripetal.z * sin(-PI/2), 0, centripetal.x * sin(-PI/2) + centripetal.z * cos(-PI/2));
 		}
@@ -82,7 +109,11 @@ public:
 		int material;
 		float rotationSpeed;
 		float revolutionSpeed;
-		vector<Moon> moons;
+		SlotMap<Moon> moons;
+		// node sits at position and carries the moons, body spins and
+		// scales the planet itself
+		SceneGraph::Node node = SceneGraph::None;
+		SceneGraph::Node body = SceneGraph::None;
 		Planet(vec3 position, int material, float rotationSpeed, float revolutionSpeed) {
 			this->position = position;
 			this->material = material;
@@ -115,22 +146,55 @@ public:
 
 	WindowManager * windowManager = nullptr;
 
+	// Randomness. Every subsystem draws from its own stream of the world
+	// seed so generation order (or thread count) never changes the result.
+	enum RandomStreams { STREAM_PLANETS, STREAM_ASTEROIDS, STREAM_PARTICLES, STREAM_SIM, STREAM_SECTORS, STREAM_PLACEMENT };
+	uint64_t seed = 1;
+	RandomStream simRandom;
+	RandomStream particleRandom;
+	uint64_t emitterCount = 0;
+
+	// Input recording / replay. simStep counts completed simulation steps,
+	// the sim advances exactly one step per rendered frame.
+	InputRecorder recorder;
+	InputReplay replay;
+	uint32_t simStep = 0;
+
+	// Benchmarking. worldScale multiplies the number of generated bodies.
+	float worldScale = 1.0f;
+	Benchmark *bench = nullptr;
+
+	// Profiler trace written by F12
+	std::string tracePath = "trace.json";
+
 	// Shader programs
-	std::shared_ptr<Program> prog;
-	std::shared_ptr<Program> blurProg;
+	ShaderVariants scene;
 	std::shared_ptr<Program> cubeProg;
-	std::shared_ptr<Program> texProg;
 	std::shared_ptr<Program> texProgNoLighting;
+	std::shared_ptr<Program> portalProg;
 
-	// Meshes
+	// Meshes, all in one vertex and index buffer
+	MeshPool meshPool;
 	vector<pair<vector<shared_ptr<Shape> >, float> > meshes;
+	map<string, size_t> meshFiles;
 	shared_ptr<Shape> cube;
 
 	//the image to use as a texture (ground)
-	vector<Planet> planets;
+	SlotMap<Planet> planets;
+	// planets and the moons around them
+	SceneGraph sceneGraph;
 	vector<Asteroid> asteroids;
-	vector<Moon> looseMoons;
-	vector<Rocket> rockets;
+	SlotMap<Moon> looseMoons;
+	// threads for CPU work inside a frame, e.g. gravity
+	ThreadPool workers;
+	// what pulls on the loose moons
+	NBody gravity{&workers};
+	const float PlanetMass = .5f;
+	// textures decode in the background and upload a few per frame
+	AssetLoader loader;
+	// everything outside the home system, streamed in around the ship
+	unique_ptr<Universe> universe;
+	SlotMap<Rocket> rockets;
 	vector<shared_ptr<Texture> > planetTextures;
 	vector<shared_ptr<Texture> > shipTextures;
 	shared_ptr<Texture> sun;
@@ -141,8 +205,9 @@ public:
 	float sunRadius = 100.0f;
 	float ufoRotation = 0;
 	int ufoTimer = 0;
-	Planet* ufoDst;
-	Planet* ufoSrc;
+	// the UFO flies from src to dst, new ones are picked when they are gone
+	SlotMap<Planet>::Handle ufoDst;
+	SlotMap<Planet>::Handle ufoSrc;
 	int matIndex = 5;
 
 	// Controls
@@ -164,26 +229,62 @@ public:
 
 	// Particles
 	std::shared_ptr<Program> partProg;
-	vector<shared_ptr<particleSys> > particleSystems;
+	SlotMap<shared_ptr<particleSys> > particleSystems;
+	// drawn before the other emitters
+	SlotMap<shared_ptr<particleSys> >::Handle sunGlow;
 	vector<shared_ptr<Texture> > particleTextures;
 
+	// Model, view and the two projections of render(), reset every frame
+	shared_ptr<MatrixStack> frameStacks[4] = { make_shared<MatrixStack>(), make_shared<MatrixStack>(), make_shared<MatrixStack>(), make_shared<MatrixStack>() };
+
 	// Worm Hole
 	shared_ptr<MatrixStack> above = make_shared<MatrixStack>();
-	glm::mat4 wormHoleView;
+	// View and eye of the portal pass being drawn while fromShip is false
+	glm::mat4 passView;
+	vec3 passEye;
 	bool fromShip;
-	unsigned int fbo;
-	unsigned int rbo;
-	unsigned int textureColorbuffer;
+	// Portal images are rendered into the lower left quarter of targets at
+	// most fboRes times the (settled) window size. Per frame at most as many pixels as
+	// one full size image are spent on portals, see PortalSystem.
+	RenderTargetManager renderTargets;
+	PortalSystem portals{renderTargets};
+
+	// Transient data of the current frame, reset at the start of the next
+	FrameArena frameArena;
+	// Passes of the current frame, see render()
+	FrameGraph graph{renderTargets, frameArena};
+
+	// Scene draws, sorted to keep state changes down
+	RenderQueue queue;
+	// Point lights around the sun, most important first, at most MaxLights.
+	// A light is left out of a draw if, seen from the object, it is within
+	// LightTolerance (radians) of a light already in.
+	static const int MaxLights = 3;
+	vector<vec3> lights = { vec3(0, 0, 0), vec3(0, -5, 0), vec3(0, 5, 0) };
+	const float LightTolerance = .035f;
+
+	// queue index of the lit scene variant, by textured and light count
+	int sceneIndex[2][MaxLights + 1];
+
+	// Rockets, explosions and UFO beams light what is around them. Gathered
+	// once a frame and binned into clusters for every view drawn.
+	LightClusters clusters;
+	vector<PointLight> dynamicLights;
+	static const int ClusterUnit = 8;
+	const float RocketLight = 15.0f;
+	const float ExplosionLight = 40.0f;
+	const float BeamLight = 25.0f;
+
+	// Post processing
+	Bloom bloom;
 	int fboRes = 4;
-	vec3 wormHoleSrc = vec3(0, 0, 250);
-	vec3 wormHoleDst = vec3(100, 0, 0);
+	int maxTextureSize = 4096;
 	float fov = 180.0f - 18.72f;
 
 	void expandSun() {
 		sunRadius += 10;
-		createParticles(vec3(0, 0, 0), 0, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(1.0f, 0.7f, 0.0f), vec2(100000, 0), 65.0f*sunRadius/100.0f);
-		particleSystems[0] = particleSystems[particleSystems.size() - 1];
-		particleSystems.erase(particleSystems.end()-1);
+		particleSystems.remove(sunGlow);
+		sunGlow = createParticles(vec3(0, 0, 0), 0, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(1.0f, 0.7f, 0.0f), vec2(100000, 0), 65.0f*sunRadius/100.0f);
 	}
 
 	void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
@@ -192,6 +293,26 @@ public:
 		{
 			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+		if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+		{
+			Profiler::dump(tracePath);
+		}
+		// during a replay the recording is the only source of gameplay input,
+		// and key repeats never affect gameplay so they aren't recorded
+		if (replay.isOpen() || action == GLFW_REPEAT) {
+			return;
+		}
+		InputEvent e;
+		e.step = simStep;
+		e.type = InputEvent::KEY;
+		e.key = key;
+		e.action = action;
+		recorder.record(e);
+		applyKey(key, action);
+	}
+
+	void applyKey(int key, int action)
+	{
 		if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
 			glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 		}
@@ -199,11 +320,17 @@ public:
 			glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 		}
 		if (key == GLFW_KEY_R && action == GLFW_PRESS) {
-			rockets.push_back(Rocket(position + 1.5f*normalize(lookAt - position), lookAt - position, vec3(glm::clamp(2*tilt, -PI/4, PI/4), -lookTheta+PI, -lookPhi + uptilt)));
+			rockets.insert(Rocket(position + 1.5f*normalize(lookAt - position), lookAt - position, vec3(glm::clamp(2*tilt, -PI/4, PI/4), -lookTheta+PI, -lookPhi + uptilt)));
 		}
 		if (key == GLFW_KEY_M && action == GLFW_PRESS){
 			matIndex++;
 		}
+		if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+			bloom.enabled = !bloom.enabled;
+		}
+		if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+			portals.mode = portals.mode == PortalSystem::STENCIL ? PortalSystem::OFFSCREEN : PortalSystem::STENCIL;
+		}
 		if (key == GLFW_KEY_W) {
 			if (action == GLFW_PRESS) {
 				wKey = true;
@@ -256,20 +383,25 @@ public:
 	{
 		WIDTH = width;
 		HEIGHT = height;
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WIDTH, HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WIDTH, HEIGHT);
-
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WIDTH*2*fboRes, HEIGHT*2*fboRes, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WIDTH*2*fboRes, HEIGHT*2*fboRes);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+		// offscreen targets follow once the size settles
+		renderTargets.resize(width, height);
 	}
 
 	void scrollCallback(GLFWwindow *window, double deltaX, double deltaY)
+	{
+		if (replay.isOpen()) {
+			return;
+		}
+		InputEvent e;
+		e.step = simStep;
+		e.type = InputEvent::SCROLL;
+		e.dx = (float)deltaX;
+		e.dy = (float)deltaY;
+		recorder.record(e);
+		applyScroll(e.dx, e.dy);
+	}
+
+	void applyScroll(float deltaX, float deltaY)
 	{
 		// uncomment for natural scrolling
 		// deltaX = -deltaX;
@@ -282,79 +414,58 @@ public:
 		lookPhi = clamp<float>(lookPhi, -PI*89.999/180, PI*89.99/180);
 	}
 
-	bool nearOtherPlanets(vec2 p, float distance) {
-		for (int i = 0; i < planets.size(); i++) {
-			if (glm::distance(p, vec2(planets[i].position.x, planets[i].position.z)) < distance) {
-				return true;
-			}
-		}
-		return false;
-	}
-
 	void init(const std::string& resourceDirectory)
 	{
 		GLSL::checkVersion();
 		glClearColor(.2f, 0, 0, 1.0f);
-
-		prog = make_shared<Program>();
-		prog->setVerbose(true);
-		prog->setShaderNames(resourceDirectory + "/simple_vert.glsl", resourceDirectory + "/simple_frag.glsl");
-		prog->init();
-		prog->addUniform("P");
-		prog->addUniform("V");
-		prog->addUniform("M");
-		prog->addUniform("MatAmb");
-		prog->addUniform("MatDif");
-		prog->addUniform("MatSpec");
-		prog->addUniform("MatShine");
-		prog->addUniform("lightPos");
-		prog->addUniform("lightPos2");
-		prog->addUniform("lightPos3");
-		prog->addUniform("camPos");
-		prog->addAttribute("vertPos");
-		prog->addAttribute("vertNor");
-
-		blurProg = make_shared<Program>();
-		blurProg->setVerbose(true);
-		blurProg->setShaderNames(resourceDirectory + "/blur_vert.glsl", resourceDirectory + "/blur_frag.glsl");
-		blurProg->init();
-		blurProg->addAttribute("aPos");
-		blurProg->addAttribute("aTexCoords");
-
-		texProg = make_shared<Program>();
-		texProg->setVerbose(true);
-		texProg->setShaderNames(resourceDirectory + "/tex_vert.glsl", resourceDirectory + "/tex_frag0.glsl");
-		texProg->init();
-		texProg->addUniform("P");
-		texProg->addUniform("V");
-		texProg->addUniform("M");
-		texProg->addUniform("lightPos");
-		texProg->addUniform("lightPos2");
-		texProg->addUniform("lightPos3");
-		texProg->addUniform("camPos");
-		texProg->addUniform("Texture0");
-		texProg->addAttribute("vertPos");
-		texProg->addAttribute("vertNor");
-		texProg->addAttribute("vertTex");
-		
-		texProgNoLighting = make_shared<Program>();
-		texProgNoLighting->setVerbose(true);
-		texProgNoLighting->setShaderNames(resourceDirectory + "/tex_vert.glsl", resourceDirectory + "/tex_frag1.glsl");
-		texProgNoLighting->init();
-		texProgNoLighting->addUniform("P");
-		texProgNoLighting->addUniform("V");
-		texProgNoLighting->addUniform("M");
-		texProgNoLighting->addUniform("lightPos");
-		texProgNoLighting->addUniform("camPos");
-		texProgNoLighting->addUniform("Texture0");
-		texProgNoLighting->addAttribute("vertPos");
-		texProgNoLighting->addAttribute("vertNor");
-		texProgNoLighting->addAttribute("vertTex");
+		// room for a volley, so firing doesn't grow the vector mid-game
+		rockets.reserve(64);
+
+		// lit objects, with and without texture, for every light count, and
+		// the unlit sun
+		scene.setShaderNames(resourceDirectory + "/scene_vert.glsl", resourceDirectory + "/scene_frag.glsl");
+		// each variant only looks up what its defines leave in
+		scene.addUniform("P");
+		scene.addUniform("V");
+		scene.addUniform("M");
+		scene.addUniform("Texture0", ShaderVariants::IF_TEXTURED);
+		const char *materialUniforms[] = { "MatAmb", "MatDif", "MatSpec", "MatShine" };
+		for (size_t i = 0; i < sizeof(materialUniforms)/sizeof(materialUniforms[0]); i++) {
+			scene.addUniform(materialUniforms[i], ShaderVariants::IF_UNTEXTURED);
+		}
+		const char *lightUniforms[] = { "lightPos", "camPos",
+			"ClusterGrid", "ClusterLights", "LightData", "ClusterOrigin", "ClusterScale", "ClusterDepth", "ClusterCount" };
+		for (size_t i = 0; i < sizeof(lightUniforms)/sizeof(lightUniforms[0]); i++) {
+			scene.addUniform(lightUniforms[i], ShaderVariants::IF_LIT);
+		}
+		scene.addAttribute("vertPos");
+		scene.addAttribute("vertNor");
+		scene.addAttribute("vertTex", ShaderVariants::IF_TEXTURED);
+		for (int n = 1; n <= (int)lights.size(); n++) {
+			scene.add(false, n);
+			scene.add(true, n);
+		}
+		texProgNoLighting = scene.add(true, 0);
+
+		bloom.init(resourceDirectory);
+
+		portalProg = make_shared<Program>();
+		portalProg->setVerbose(true);
+		portalProg->setShaderNames(resourceDirectory + "/tex_vert.glsl", resourceDirectory + "/portal_frag.glsl");
+		portalProg->begin();
+		portalProg->addUniform("P");
+		portalProg->addUniform("V");
+		portalProg->addUniform("M");
+		portalProg->addUniform("Texture0");
+		portalProg->addUniform("Reproject");
+		portalProg->addAttribute("vertPos");
+		portalProg->addAttribute("vertNor");
+		portalProg->addAttribute("vertTex");
 
 		cubeProg = make_shared<Program>();
 		cubeProg->setVerbose(true);
 		cubeProg->setShaderNames(resourceDirectory + "/cube_vert.glsl", resourceDirectory + "/cube_frag.glsl");
-		cubeProg->init();
+		cubeProg->begin();
 		cubeProg->addUniform("P");
 		cubeProg->addUniform("V");
 		cubeProg->addUniform("M");
@@ -383,12 +494,7 @@ public:
 			"swamp.jpg"
 		};
 		for (int i = 0; i < 18; i++) {
-			shared_ptr<Texture> t = make_shared<Texture>();
-			t->setFilename(resourceDirectory + "/planets/" + directs[i]);
-			t->init();
-			t->setUnit(0);
-			t->setWrapModes(GL_REPEAT, GL_REPEAT);
-			planetTextures.push_back(t);
+			planetTextures.push_back(loadTexture(resourceDirectory + "/planets/" + directs[i], GL_REPEAT, 128));
 		}
 
 		string directs2[] = {
@@ -402,36 +508,18 @@ public:
 			"black.png"
 		};
 		for (int i = 0; i < 8; i++) {
-			shared_ptr<Texture> t = make_shared<Texture>();
-			t->setFilename(resourceDirectory + "/ships/" + directs2[i]);
-			t->init();
-			t->setUnit(0);
-			t->setWrapModes(GL_REPEAT, GL_REPEAT);
-			shipTextures.push_back(t);
-		}
-
-		sun = make_shared<Texture>();
-		sun->setFilename(resourceDirectory + "/planets/sun.jpg");
-		sun->init();
-		sun->setUnit(0);
-		sun->setWrapModes(GL_REPEAT, GL_REPEAT);
-
-		rocket = make_shared<Texture>();
-		rocket->setFilename(resourceDirectory + "/rocket.png");
-		rocket->init();
-		rocket->setUnit(0);
-		rocket->setWrapModes(GL_REPEAT, GL_REPEAT);
+			shipTextures.push_back(loadTexture(resourceDirectory + "/ships/" + directs2[i], GL_REPEAT, 128));
+		}
+
+		sun = loadTexture(resourceDirectory + "/planets/sun.jpg", GL_REPEAT, 255);
+		rocket = loadTexture(resourceDirectory + "/rocket.png", GL_REPEAT, 128);
 
 		partProg = make_shared<Program>();
 		partProg->setVerbose(true);
 		partProg->setShaderNames(
 			resourceDirectory + "/lab10_vert.glsl",
 			resourceDirectory + "/lab10_frag.glsl");
-		if (! partProg->init())
-		{
-			std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
-			exit(1);
-		}
+		partProg->begin();
 		partProg->addUniform("P");
 		partProg->addUniform("M");
 		partProg->addUniform("V");
@@ -439,85 +527,103 @@ public:
 		partProg->addAttribute("vertPos");
 		partProg->addAttribute("vertColor");
 
-		shared_ptr<Texture> particleExplosion = make_shared<Texture>();
-		particleExplosion->setFilename(resourceDirectory + "/alpha.bmp");
-		particleExplosion->init();
-		particleExplosion->setUnit(0);
-		particleExplosion->setWrapModes(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-		particleTextures.push_back(particleExplosion);
-		shared_ptr<Texture> particleBeam = make_shared<Texture>();
-		particleBeam->setFilename(resourceDirectory + "/beam.jpg");
-		particleBeam->init();
-		particleBeam->setUnit(0);
-		particleBeam->setWrapModes(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
-		particleTextures.push_back(particleBeam);
-
-		for (int i = 0; i < 50; i++) {
-			vec2 p;
-			do {
-				p = glm::diskRand(100.0);
-			} while (glm::length(p) < 20 || nearOtherPlanets(p, 15));
+		// particles stay invisible until theirs are in
+		particleTextures.push_back(loadTexture(resourceDirectory + "/alpha.bmp", GL_CLAMP_TO_EDGE, 0));
+		particleTextures.push_back(loadTexture(resourceDirectory + "/beam.jpg", GL_CLAMP_TO_EDGE, 0));
+
+		RandomStream world(seed);
+		simRandom = world.substream(STREAM_SIM);
+		particleRandom = world.substream(STREAM_PARTICLES);
+		RandomStream planetRandom = world.substream(STREAM_PLANETS);
+		// keep the planet density (and the belt just outside the disk) when scaling
+		const int numPlanets = (int)(50 * worldScale);
+		const float diskRadius = 100.0f * sqrt(worldScale);
+		// planets at least 15 apart, moons at least 1.5 around their planet
+		PoissonDisk poisson;
+		vector<vec2> spots, moonSpots;
+		RandomStream placement = world.substream(STREAM_PLACEMENT);
+		poisson.sample(placement, 20, diskRadius, 15, numPlanets, spots);
+		for (size_t i = 0; i < spots.size(); i++) {
+			// each planet and its moons come from the planet's own stream
+			RandomStream r = planetRandom.substream(i);
+			vec2 p = spots[i];
 			Planet planet(
-				vec3(p.x, glm::linearRand(-3, 3), p.y),
-				(int)glm::linearRand(0, 17),
-				glm::linearRand(0.5, 1.5) * ((.2 < glm::linearRand(0, 1)) ? 1 : -1),
-				glm::linearRand(0.025, .03)
+				vec3(p.x, r.uniform(-3, 3), p.y),
+				r.uniformInt(0, 17),
+				r.uniform(0.5, 1.5) * ((.2 < r.nextFloat()) ? 1 : -1),
+				r.uniform(0.025, .03)
 			);
-			while (glm::linearRand(0, 1) < .5) {
-				do {
-					p = glm::diskRand(6.0);
-				} while (glm::length(p) < 3);
-				planet.moons.push_back(Moon(
-					vec3(p.x, glm::linearRand(-1, 1), p.y),
-					(int)glm::linearRand(0, 17),
-					glm::linearRand(0.5, 1.5) * ((.2 < glm::linearRand(0, 1)) ? 1 : -1),
-					glm::linearRand(0.5, 2.0)
+			int numMoons = 0;
+			while (r.nextFloat() < .5) {
+				numMoons++;
+			}
+			poisson.sample(r, 3, 6, 1.5f, numMoons, moonSpots);
+			for (size_t m = 0; m < moonSpots.size(); m++) {
+				p = moonSpots[m];
+				planet.moons.insert(Moon(
+					vec3(p.x, r.uniform(-1, 1), p.y),
+					r.uniformInt(0, 17),
+					r.uniform(0.5, 1.5) * ((.2 < r.nextFloat()) ? 1 : -1),
+					r.uniform(0.5, 2.0)
 				));
 			}
-			planets.push_back(planet);
-		}
-		for (int i = 0; i < 100; i++) {
-			float radius = glm::linearRand(110.0, 160.0);
-			float angle = glm::linearRand(0.0f, 2*PI);
-			float rot = glm::linearRand(1.0f, 1.5f);
-			float rev = glm::linearRand(.075f, 0.125f);
-			float size = glm::linearRand(.01f, .0175f);
-			asteroids.push_back(Asteroid(radius, angle, rot, rev, size));
-		}
-
-		ufoSrc = &planets[std::rand() % planets.size()];
-		ufoDst = &planets[std::rand() % planets.size()];
-
-		glGenFramebuffers(1, &fbo);
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);  
-
-		glGenTextures(1, &textureColorbuffer);
-		glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, WIDTH*2*fboRes, HEIGHT*2*fboRes, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer, 0);
-
-		glGenRenderbuffers(1, &rbo);
-		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WIDTH*2*fboRes, HEIGHT*2*fboRes); // use a single renderbuffer object for both a depth AND stencil buffer.
-		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo); // now actually attach it
-		// now that we actually created the framebuffer and added all attachments we want to check if it is actually complete now
-		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-			cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		createParticles(vec3(0, 0, 0), 0, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(1.0f, 0.7f, 0.0f), vec2(100000, 0), 65.0f*sunRadius/100.0f);
+			planet.node = sceneGraph.add(SceneGraph::None);
+			planet.body = sceneGraph.add(planet.node);
+			for (size_t m = 0; m < planet.moons.size(); m++) {
+				planet.moons[m].node = sceneGraph.add(planet.node);
+			}
+			planets.insert(planet);
+		}
+		// asteroids are independent of each other, so fill them in batches
+		const int numAsteroids = (int)(100 * worldScale);
+		RandomStream asteroidRandom = world.substream(STREAM_ASTEROIDS);
+		vector<float> radius(numAsteroids), angle(numAsteroids), rot(numAsteroids), rev(numAsteroids), size(numAsteroids);
+		asteroidRandom.substream(0).fill(&radius[0], numAsteroids, diskRadius + 10.0f, diskRadius + 60.0f);
+		asteroidRandom.substream(1).fill(&angle[0], numAsteroids, 0.0f, 2*PI);
+		asteroidRandom.substream(2).fill(&rot[0], numAsteroids, 1.0f, 1.5f);
+		asteroidRandom.substream(3).fill(&rev[0], numAsteroids, .075f, 0.125f);
+		asteroidRandom.substream(4).fill(&size[0], numAsteroids, .01f, .0175f);
+		for (int i = 0; i < numAsteroids; i++) {
+			asteroids.push_back(Asteroid(radius[i], angle[i], rot[i], rev[i], size[i]));
+		}
+
+		ufoSrc = randomPlanet();
+		ufoDst = randomPlanet();
+
+		universe.reset(new Universe(world.substream(STREAM_SECTORS), &workers));
+		universe->clearRadius = diskRadius + 200.0f;
+
+		sunGlow = createParticles(vec3(0, 0, 0), 0, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(1.0f, 0.7f, 0.0f), vec2(100000, 0), 65.0f*sunRadius/100.0f);
+	}
+
+	// A one pixel texture of the given grey until the loader has uploaded
+	// the image
+	shared_ptr<Texture> loadTexture(const string &path, GLint wrap, unsigned char shade) {
+		shared_ptr<Texture> t = AssetLoader::placeholder(shade, shade, shade);
+		t->setFilename(path);
+		t->setUnit(0);
+		t->setWrapModes(wrap, wrap);
+		loader.loadTexture(path, t);
+		return t;
 	}
 
-	void load(string path) {
-		vector<tinyobj::shape_t> TOshapes;
-		vector<tinyobj::material_t> objMaterials;
-		string errStr;
+	struct ObjFile {
+		vector<tinyobj::shape_t> shapes;
+		vector<tinyobj::material_t> materials;
+		string error;
+		bool ok = false;
+	};
 
-		bool rc = tinyobj::LoadObj(TOshapes, objMaterials, errStr, path.c_str());
-		if (!rc) {
-			cerr << errStr << endl;
+	void load(const string &path, ObjFile &file) {
+		// the same model under several indices shares its geometry
+		map<string, size_t>::iterator loaded = meshFiles.find(path);
+		if (loaded != meshFiles.end()) {
+			meshes.push_back(meshes[loaded->second]);
+			return;
+		}
+		vector<tinyobj::shape_t> &TOshapes = file.shapes;
+		if (!file.ok) {
+			cerr << file.error << endl;
 		} else {
 			vector<shared_ptr<Shape> > newMeshes;
 			float boundingSphereRadius = 0;
@@ -525,7 +631,7 @@ public:
 				shared_ptr<Shape> mesh = make_shared<Shape>();
 				mesh->createShape(TOshapes[i]);
 				mesh->measure();
-				mesh->init();
+				mesh->init(meshPool);
 				for (int j = 0; j < TOshapes[i].mesh.positions.size(); j += 3) {
 					mesh->min.x = std::min(mesh->min.x, TOshapes[i].mesh.positions[j]);
 					mesh->min.y = std::min(mesh->min.y, TOshapes[i].mesh.positions[j+1]);
@@ -537,52 +643,104 @@ public:
 				newMeshes.push_back(mesh);
 				boundingSphereRadius = std::max(boundingSphereRadius, std::max(mesh->max.x, mesh->max.y));
 			}
+			meshFiles[path] = meshes.size();
 			meshes.push_back(make_pair(newMeshes, boundingSphereRadius));
 		}
 	}
 
 	void initGeom(const std::string& resourceDirectory)
 	{
-		load(resourceDirectory + "/ufo.obj");
-		load(resourceDirectory + "/smoothsphere.obj");
-		load(resourceDirectory + "/smoothsphere.obj");
-		load(resourceDirectory + "/spherenonormals.obj");
-		load(resourceDirectory + "/smoothsphere.obj");
-		load(resourceDirectory + "/ship.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/rock.obj");
-		load(resourceDirectory + "/Earth.obj");
-		load(resourceDirectory + "/rocket.obj");
+		// meshes[] indices, the cube last
+		const char *names[] = {
+			"ufo.obj",
+			"smoothsphere.obj",
+			"smoothsphere.obj",
+			"spherenonormals.obj",
+			"smoothsphere.obj",
+			"ship.obj",
+			"rock.obj",
+			"rock.obj",
+			"rock.obj",
+			"rock.obj",
+			"rock.obj",
+			"rock.obj",
+			"Earth.obj",
+			"rocket.obj",
+			"cube.obj"
+		};
+		const int count = sizeof(names)/sizeof(names[0]);
+
+		// sizes and collisions depend on the meshes, so they are waited for,
+		// but every distinct file is parsed on a loader thread at once
+		map<string, ObjFile> files;
+		vector<future<void> > parsing;
+		for (int i = 0; i < count; i++) {
+			string path = resourceDirectory + "/" + names[i];
+			if (files.find(path) != files.end()) {
+				continue;
+			}
+			ObjFile *file = &files[path];
+			parsing.push_back(loader.run([file, path] {
+				file->ok = tinyobj::LoadObj(file->shapes, file->materials, file->error, path.c_str());
+			}));
+		}
+		for (size_t i = 0; i < parsing.size(); i++) {
+			parsing[i].get();
+		}
+
+		for (int i = 0; i < count - 1; i++) {
+			string path = resourceDirectory + "/" + names[i];
+			load(path, files[path]);
+		}
 
 		// Initialize cube mesh.
-		vector<tinyobj::shape_t> TOshapesC;
- 		vector<tinyobj::material_t> objMaterialsC;
-		string errStr;
-		bool rc = tinyobj::LoadObj(TOshapesC, objMaterialsC, errStr, (resourceDirectory + "/cube.obj").c_str());
-		if (!rc) {
-			cerr << errStr << endl;
+		ObjFile &cubeFile = files[resourceDirectory + "/" + names[count - 1]];
+		if (!cubeFile.ok) {
+			cerr << cubeFile.error << endl;
 		} else {
 			cube = make_shared<Shape>();
-			cube->createShape(TOshapesC[0]);
+			cube->createShape(cubeFile.shapes[0]);
 			cube->measure();
-			cube->init();
+			cube->init(meshPool);
 		}
+		meshPool.upload();
+
+		// sized by the planet mesh, its targets are allocated on first use
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+		portals.add(vec3(0, 0, 250), vec3(100, 0, 0), meshes[12].second*.2f);
+	}
+
+	// Waits for the programs init() started, compiling while the textures
+	// and meshes loaded
+	void finishPrograms()
+	{
+		shared_ptr<Program> programs[] = { portalProg, cubeProg, partProg };
+		bool ok = scene.finish();
+		for (size_t i = 0; i < sizeof(programs)/sizeof(programs[0]); i++) {
+			ok = programs[i]->finish() && ok;
+		}
+		if (!ok) {
+			std::cerr << "One or more shaders failed to compile... exiting!" << std::endl;
+			exit(1);
+		}
+		for (int n = 1; n <= (int)lights.size(); n++) {
+			sceneIndex[0][n] = queue.addProgram(scene.get(false, n));
+			sceneIndex[1][n] = queue.addProgram(scene.get(true, n));
+		}
+	}
+
+	// Camera sitting behind and above the ship
+	mat4 shipView() {
+		return glm::translate(mat4(1.0f), vec3(0, -1.5, -5)) * glm::lookAt(position, lookAt, vec3(0, 1, 0));
 	}
 
 	void SetView(shared_ptr<Program> shader) {
 		if (fromShip) {
 			above->loadIdentity();
-			above->translate(vec3(0, -1.5, -5));
-			glm::mat4 Cam = glm::lookAt(position, lookAt, vec3(0, 1, 0));
-			above->multMatrix(Cam);
+			above->multMatrix(shipView());
 			glUniformMatrix4fv(shader->getUniform("V"), 1, GL_FALSE, value_ptr(above->topMatrix()));
 		} else {
-			wormHoleView = glm::lookAt(wormHoleDst, wormHoleDst + (wormHoleSrc - position), vec3(0, 1, 0));
-			glUniformMatrix4fv(shader->getUniform("V"), 1, GL_FALSE, value_ptr(wormHoleView));
+			glUniformMatrix4fv(shader->getUniform("V"), 1, GL_FALSE, value_ptr(passView));
 		}
 	}
 
@@ -591,16 +749,14 @@ public:
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 		
-		int width, height, nrChannels;
-		stbi_set_flip_vertically_on_load(false);
+		// black until the loader has the faces
+		const unsigned char black[3] = { 0, 0, 0 };
+		vector<string> paths;
 		for(GLuint i = 0; i < faces.size(); i++) {
-			unsigned char *data = stbi_load((dir+faces[i]).c_str(), &width, &height, &nrChannels, 0);
-			if (data) {
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			} else {
-				cout << "failed to load: " << (dir+faces[i]).c_str() << endl;
-			}
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, black);
+			paths.push_back(dir + faces[i]);
 		}
+		loader.loadCubeMap(paths, textureID);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -644,173 +800,298 @@ public:
 		uptilt = 0;
 	}
 
-	void createParticles(vec3 position, int textureIndex, int numP, float radius, vec3 bias, vec3 vMax, vec3 c, vec2 life, float scale) {
+	// Frees the planet's moons, spawns its explosion and takes it out of the
+	// scene graph; the caller removes the planet
+	void explode(Planet &planet) {
+		for (SlotMap<Moon>::iterator j = planet.moons.begin(); j != planet.moons.end(); j++) {
+			j->escape(planet.position, sceneGraph.worldPosition(j->node));
+			looseMoons.insert(*j);
+		}
+		sceneGraph.remove(planet.node);
+		createParticles(planet.position, 0, 300, .01*meshes[12].second/4.0f, vec3(0, 0, 0), vec3(2, 2, 2), vec3(.5f, .2f, 0.0f), vec2(2.0f, 3.0f), 1.0f, ExplosionLight);
+	}
+
+	// Points the ship from eye towards target, used by scripted cameras
+	void setCamera(vec3 eye, vec3 target) {
+		vec3 d = normalize(target - eye);
+		position = eye;
+		lookPhi = asin(clamp(d.y, -1.0f, 1.0f));
+		lookTheta = atan2(d.z, d.x);
+		move = vec3(0, 0, 0);
+		speed = 0;
+	}
+
+	// Applies the benchmark scenario's camera and events for the coming step
+	void applyScenario() {
+		const Scenario &scenario = bench->getScenario();
+		vec3 eye, target;
+		scenario.cameraAt(simStep, eye, target);
+		setCamera(eye, target);
+		vector<Scenario::Event> events = scenario.eventsAt(simStep);
+		for (size_t i = 0; i < events.size(); i++) {
+			if (events[i].type == Scenario::Event::ROCKET) {
+				applyKey(GLFW_KEY_R, GLFW_PRESS);
+			} else if (events[i].type == Scenario::Event::EXPLODE) {
+				for (int n = 0; n < events[i].count && planets.size() > 2; n++) {
+					int k = simRandom.uniformInt(0, planets.size() - 1);
+					explode(planets[k]);
+					planets.removeAt(k);
+				}
+			}
+		}
+	}
+
+	void mark(Benchmark::Phase phase) {
+		if (bench) {
+			bench->mark(phase);
+		}
+	}
+
+	SlotMap<shared_ptr<particleSys> >::Handle createParticles(vec3 position, int textureIndex, int numP, float radius, vec3 bias, vec3 vMax, vec3 c, vec2 life, float scale, float lightRadius = 0) {
 		shared_ptr<particleSys> p = make_shared<particleSys>(position, textureIndex, numP, radius, bias, vMax, c, life, scale);
+		p->lightRadius = lightRadius;
+		p->setRandom(particleRandom.substream(emitterCount++));
 		p->gpuSetup();
-		particleSystems.push_back(p);
+		return particleSystems.insert(p);
+	}
+
+	SlotMap<Planet>::Handle randomPlanet() {
+		return planets.empty() ? SlotMap<Planet>::Handle() : planets.handle(simRandom.uniformInt(0, planets.size() - 1));
 	}
 
 	void drawSkybox(shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		PROFILE_SCOPE("drawSkybox");
 		cubeProg->bind();
 		glUniformMatrix4fv(cubeProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
-		glDepthFunc(GL_LEQUAL);
 		SetView(cubeProg);
-		auto Identity = make_shared<MatrixStack>();
-		Identity->translate(position);
-		Identity->scale(vec3(1000, 1000, 1000));
-		glUniformMatrix4fv(cubeProg->getUniform("M"), 1, GL_FALSE, value_ptr(Identity->topMatrix()));
+		MatrixStack Identity;
+		Identity.translate(fromShip ? position : passEye);
+		Identity.scale(vec3(1000, 1000, 1000));
+		glUniformMatrix4fv(cubeProg->getUniform("M"), 1, GL_FALSE, value_ptr(Identity.topMatrix()));
 		glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
 		cube->draw(cubeProg);
-		glDepthFunc(GL_LESS);
 		cubeProg->unbind();
 	}
 	
+	// Fewest lights, taken in order, that light a sphere at center like all
+	// of them do. The shaders keep the brightest light per fragment, so a
+	// light that comes from about the same direction as one already taken
+	// adds nothing.
+	int lightsFor(const vec3 &center, float radius) {
+		int n = 1;
+		for (int i = 1; i < (int)lights.size(); i++) {
+			float nearest = std::max(distance(lights[i], center) - radius, 1e-3f);
+			bool covered = false;
+			for (int j = 0; j < n && !covered; j++) {
+				covered = distance(lights[i], lights[j]) / nearest < LightTolerance;
+			}
+			if (!covered) {
+				n = i + 1;
+			}
+		}
+		return n;
+	}
+
+	int litProgram(bool textured, const vec3 &center, float radius) {
+		return sceneIndex[textured][lightsFor(center, radius)];
+	}
+
+	// Moves the planets, their moons and the UFO one step, brings the scene
+	// graph up to date and resolves what hit them. Every view of the frame
+	// then draws the same world transforms. Planets orbit and spin every
+	// frame, so all their nodes are recomputed; only nodes whose transform
+	// held still are skipped.
+	void updatePlanets() {
+		planetRotation += .01;
+		for (SlotMap<Planet>::iterator i = planets.begin(); i != planets.end(); i++) {
+			i->position += i->revolutionSpeed*normalize(vec3(i->position.x * cos(-PI/2) - i->position.z * sin(-PI/2), 0, i->position.x * sin(-PI/2) + i->position.z * cos(-PI/2)));
+			sceneGraph.setLocal(i->node, Transform::translate(i->position));
+			sceneGraph.setLocal(i->body, Transform::rotate(planetRotation*i->rotationSpeed, vec3(0, 1, 0)) * Transform::scaling(vec3(.01f)));
+			for (SlotMap<Moon>::iterator j = i->moons.begin(); j != i->moons.end(); j++) {
+				sceneGraph.setLocal(j->node, Transform::rotate(planetRotation*j->revolutionSpeed, vec3(0, 1, 0))
+					* Transform::translate(j->position)
+					* Transform::rotate(planetRotation*j->rotationSpeed, vec3(0, 1, 0))
+					* Transform::scaling(vec3(.003f)));
+			}
+		}
+		sceneGraph.update();
+
+		// removing puts the last planet, moon or rocket at the current index,
+		// so the index only advances past survivors
+		for (size_t i = 0; i < planets.size();) {
+			Planet &planet = planets[i];
+			for (size_t j = 0; j < planet.moons.size();) {
+				vec3 p = sceneGraph.worldPosition(planet.moons[j].node);
+				if (glm::distance(p, position) < meshes[12].second*.003 + meshes[5].second*.05) {
+					collide();
+				}
+				bool hit = false;
+				for (size_t k = 0; k < rockets.size() && !hit; k++) {
+					if (glm::distance(p, rockets[k].position) < meshes[12].second*.003 + meshes[13].second*.05/2) {
+						createParticles(p, 0, 100, .003*meshes[12].second/4.0f, vec3(0, 0, 0), vec3(1, 1, 1), vec3(.5f, .2f, 0.0f), vec2(2.0f, 3.0f), 1.0f, ExplosionLight);
+						rockets.removeAt(k);
+						sceneGraph.remove(planet.moons[j].node);
+						planet.moons.removeAt(j);
+						hit = true;
+					}
+				}
+				if (!hit) {
+					j++;
+				}
+			}
+
+			if (glm::distance(planet.position, position) < meshes[12].second*.01 + meshes[5].second*.05) {
+				collide();
+			}
+			if (glm::distance(vec3(0, 0, 0), planet.position) < meshes[12].second*.01 + meshes[12].second*sunRadius/2000.0f) {
+				sceneGraph.remove(planet.node);
+				planets.removeAt(i);
+				expandSun();
+				continue;
+			}
+			bool hit = false;
+			for (size_t k = 0; k < rockets.size() && !hit; k++) {
+				if (glm::distance(planet.position, rockets[k].position) < meshes[12].second*.01 + meshes[13].second*.05/2) {
+					explode(planet);
+					rockets.removeAt(k);
+					planets.removeAt(i);
+					hit = true;
+				}
+			}
+			if (!hit) {
+				i++;
+			}
+		}
+
+		// loose moons fall towards the sun and every planet, they are too
+		// light to pull on anything themselves
+		gravity.clear();
+		gravity.add(vec3(0, 0, 0), sunRadius/10.0f);
+		for (size_t i = 0; i < planets.size(); i++) {
+			gravity.add(planets[i].position, PlanetMass);
+		}
+		int firstMoon = gravity.size();
+		for (size_t i = 0; i < looseMoons.size(); i++) {
+			gravity.add(looseMoons[i].position, 0);
+		}
+		gravity.solve();
+		for (size_t i = 0; i < looseMoons.size(); i++) {
+			looseMoons[i].escapeDirection += gravity.acceleration(firstMoon + (int)i);
+		}
+		for (size_t i = 0; i < looseMoons.size(); i++) {
+			looseMoons[i].update();
+		}
+		for (size_t i = 0; i < looseMoons.size();) {
+			if (glm::distance(looseMoons[i].position, vec3(0, 0, 0)) < meshes[12].second*.003 + meshes[12].second*sunRadius/2000.0f) {
+				expandSun();
+				looseMoons.removeAt(i);
+			} else {
+				i++;
+			}
+		}
+
+		// the UFO moves on if its planets are gone
+		if (!planets.get(ufoSrc)) {
+			ufoSrc = planets.get(ufoDst) ? ufoDst : randomPlanet();
+		}
+		if (!planets.get(ufoDst)) {
+			ufoDst = randomPlanet();
+		}
+		// and beams down once it arrives
+		if (!planets.empty()) {
+			ufoRotation += .05;
+			ufoTimer = (ufoTimer + 1) % 240;
+			if (ufoTimer == 0) {
+				const Planet &dst = *planets.get(ufoDst);
+				createParticles(dst.position + vec3(0, 5, 0), 1, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(0.5f, 1.0f, 0.0f), vec2(1, 0), 15.0f, BeamLight);
+				ufoSrc = ufoDst;
+				ufoDst = randomPlanet();
+			}
+		}
+	}
+
+	void gatherLights() {
+		dynamicLights.clear();
+		for (size_t i = 0; i < rockets.size(); i++) {
+			dynamicLights.push_back({ rockets[i].position, RocketLight, vec3(1.0f, .6f, .2f) });
+		}
+		for (size_t i = 0; i < particleSystems.size(); i++) {
+			const particleSys &p = *particleSystems[i];
+			if (p.lightRadius > 0) {
+				// fades out with the particles
+				dynamicLights.push_back({ p.start, p.lightRadius, 2.0f * p.alive() * p.color() });
+			}
+		}
+	}
+
 	void drawEverythingElse(shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		PROFILE_SCOPE("drawEverythingElse");
+		// the projections of all views share these planes, P itself may be oblique
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		clusters.build(Perspective->topMatrix(), fromShip ? shipView() : passView, 0.1f, 1000.0f, dynamicLights);
+		clusters.upload(ClusterUnit);
+		// view dependent uniforms first, the queue switches between programs
+		for (int n = 1; n <= (int)lights.size(); n++) {
+			for (int textured = 0; textured < 2; textured++) {
+				shared_ptr<Program> p = scene.get(textured, n);
+				p->bind();
+				glUniformMatrix4fv(p->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
+				SetView(p);
+				glUniform3fv(p->getUniform("lightPos"), n, value_ptr(lights[0]));
+				// untextured objects have always been lit as if seen from the origin
+				vec3 cam = textured ? position : vec3(0);
+				glUniform3f(p->getUniform("camPos"), cam.x, cam.y, cam.z);
+				clusters.setUniforms(*p, viewport, ClusterUnit);
+			}
+		}
+		vec3 eye = fromShip ? position : passEye;
+		queue.clear();
+
 		// UFO
-		prog->bind();
-		glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
-		SetView(prog);
-		glUniform3f(prog->getUniform("lightPos"), 0, -5, 0);
-		glUniform3f(prog->getUniform("lightPos2"), 0, 0, 0);
-		glUniform3f(prog->getUniform("lightPos3"), 0, 5, 0);
 		if (!planets.empty()) {
+			const Planet &src = *planets.get(ufoSrc);
+			const Planet &dst = *planets.get(ufoDst);
 			Model->pushMatrix();
-			Model->translate(ufoTimer < 120 ? ufoSrc->position : mix(ufoSrc->position, ufoDst->position, (ufoTimer - 120.0f) / 120.0f));
+			Model->translate(ufoTimer < 120 ? src.position : mix(src.position, dst.position, (ufoTimer - 120.0f) / 120.0f));
 			Model->translate(vec3(0, 5, 0));
 			if (fromShip && ufoTimer >= 120) {
-				vec3 move = ufoDst->position - ufoSrc->position;
+				vec3 move = dst.position - src.position;
 				Model->rotate(.2f, vec3(move.x * cos(-PI/2) - move.z * sin(-PI/2), 0, move.x * sin(-PI/2) + move.z * cos(-PI/2)));
 			}
 			Model->rotate(ufoRotation, vec3(0, 1, 0));
 			Model->scale(vec3(.1, .1, .1));
-			glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
+			vec3 center(Model->topMatrix()[3]);
+			float depth = distance(eye, center);
+			int program = litProgram(false, center, meshes[0].second*.1f);
 			for (int i = 0; i < meshes[0].first.size(); i++) {
-				SetMaterial(prog, i == 0 ? 4 : 6);
-				meshes[0].first[i]->draw(prog);
+				queue.submit(0, program, nullptr, i == 0 ? 4 : 6, meshes[0].first[i].get(), Model->topMatrix(), depth);
 			}
 			Model->popMatrix();
-			if (fromShip) {
-				ufoRotation += .05;
-				ufoTimer = (ufoTimer + 1) % 240;
-				if (ufoTimer == 0) {
-					ufoSrc = ufoDst;
-					ufoDst = &planets[std::rand() % planets.size()];
-					createParticles(ufoSrc->position + vec3(0, 5, 0), 1, 1, 0, vec3(0, 0, 0), vec3(0, 0, 0), vec3(0.5f, 1.0f, 0.0f), vec2(1, 0), 15.0f);
-				}
-			}
 		}
-		prog->unbind();
 
 		// PLANETS
-		texProg->bind();
-		glUniformMatrix4fv(texProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
-		SetView(texProg);
-		glUniform3f(texProg->getUniform("lightPos"), 0, -5, 0);
-		glUniform3f(texProg->getUniform("lightPos2"), 0, 0, 0);
-		glUniform3f(texProg->getUniform("lightPos3"), 0, 5, 0);
-		glUniform3f(texProg->getUniform("camPos"), position.x, position.y, position.z);
-		for (vector<Planet>::iterator i = planets.begin(); i != planets.end(); i++) {
-			if (fromShip) {
-				i->position += i->revolutionSpeed*normalize(vec3(i->position.x * cos(-PI/2) - i->position.z * sin(-PI/2), 0, i->position.x * sin(-PI/2) + i->position.z * cos(-PI/2)));
-			}
-			Model->pushMatrix();
-			Model->translate(i->position);
-			// MOONS
-			for (vector<Moon>::iterator j = i->moons.begin(); j != i->moons.end(); j++) {
-				Model->pushMatrix();
-				Model->rotate(planetRotation*j->revolutionSpeed, vec3(0, 1, 0));
-				Model->translate(j->position);
-				Model->rotate(planetRotation*j->rotationSpeed, vec3(0, 1, 0));
-				Model->scale(vec3(.003, .003, .003));
-				glUniformMatrix4fv(texProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-				planetTextures[j->material]->bind(texProg->getUniform("Texture0"));
-				for (int i = 0; i < meshes[12].first.size(); i++) {
-					meshes[12].first[i]->draw(texProg);
-				}
-
-				if (fromShip) {
-					vec3 p = vec3(Model->topMatrix()[3][0], Model->topMatrix()[3][1], Model->topMatrix()[3][2]);
-					j->absolutePosition = p;
-					if (glm::distance(p, position) < meshes[12].second*.003 + meshes[5].second*.05) {
-						collide();
-					}
-					for (vector<Rocket>::iterator k = rockets.begin(); k != rockets.end(); k++) {
-						if (glm::distance(p, k->position) < meshes[12].second*.003 + meshes[13].second*.05/2) {
-							createParticles(j->absolutePosition, 0, 100, .003*meshes[12].second/4.0f, vec3(0, 0, 0), vec3(1, 1, 1), vec3(.5f, .2f, 0.0f), vec2(2.0f, 3.0f), 1.0f);
-							rockets.erase(k);
-							i->moons.erase(j);
-							j--;
-							break;
-						}
-					}
-				}
-				Model->popMatrix();
-			}
-			Model->rotate(planetRotation*i->rotationSpeed, vec3(0, 1, 0));
-			Model->scale(vec3(.01, .01, .01));
-			glUniformMatrix4fv(texProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-			planetTextures[i->material]->bind(texProg->getUniform("Texture0"));
-			for (int i = 0; i < meshes[12].first.size(); i++) {
-				meshes[12].first[i]->draw(texProg);
-			}
-			Model->popMatrix();
-
-			if (fromShip) {
-				if (glm::distance(i->position, position) < meshes[12].second*.01 + meshes[5].second*.05) {
-					collide();
-				}
-				if (glm::distance(vec3(0, 0, 0), i->position) < meshes[12].second*.01 + meshes[12].second*sunRadius/2000.0f) {
-					planets.erase(i);
-					i--;
-					expandSun();
-				}
-				for (vector<Rocket>::iterator j = rockets.begin(); j != rockets.end(); j++) {
-					if (glm::distance(i->position, j->position) < meshes[12].second*.01 + meshes[13].second*.05/2) {
-						// collide();
-						for (vector<Moon>::iterator j = i->moons.begin(); j != i->moons.end(); j++) {
-							j->escape(i->position);
-							looseMoons.push_back(*j);
-						}
-						createParticles(i->position, 0, 300, .01*meshes[12].second/4.0f, vec3(0, 0, 0), vec3(2, 2, 2), vec3(.5f, .2f, 0.0f), vec2(2.0f, 3.0f), 1.0f);
-						rockets.erase(j);
-						planets.erase(i);
-						i--;
-						break;
-					}
-
-				}
+		for (SlotMap<Planet>::iterator i = planets.begin(); i != planets.end(); i++) {
+			for (SlotMap<Moon>::iterator j = i->moons.begin(); j != i->moons.end(); j++) {
+				const mat4 &M = sceneGraph.world(j->node);
+				vec3 center(M[3]);
+				queue.submit(0, litProgram(true, center, meshes[12].second*.003f), planetTextures[j->material].get(), -1, meshes[12].first, M, distance(eye, center));
 			}
+			queue.submit(0, litProgram(true, i->position, meshes[12].second*.01f), planetTextures[i->material].get(), -1, meshes[12].first, sceneGraph.world(i->body), distance(eye, i->position));
 		}
 		// LOOSE MOONS
-		for (vector<Moon>::iterator i = looseMoons.begin(); i != looseMoons.end(); i++) {
-			i->update();
+		for (size_t k = 0; k < looseMoons.size(); k++) {
+			Moon *i = &looseMoons[k];
 			Model->pushMatrix();
 			Model->translate(i->position);
 			Model->rotate(planetRotation*i->rotationSpeed, vec3(0, 1, 0));
 			Model->scale(vec3(.003, .003, .003));
-			glUniformMatrix4fv(texProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-			planetTextures[i->material]->bind(texProg->getUniform("Texture0"));
-			for (int i = 0; i < meshes[12].first.size(); i++) {
-				meshes[12].first[i]->draw(texProg);
-			}
+			queue.submit(0, litProgram(true, i->position, meshes[12].second*.003f), planetTextures[i->material].get(), -1, meshes[12].first, Model->topMatrix(), distance(eye, i->position));
 			Model->popMatrix();
-
-			if (fromShip) {
-				if (glm::distance(i->position, vec3(0, 0, 0)) < meshes[12].second*.003 + meshes[12].second*sunRadius/2000.0f) {
-					expandSun();
-					looseMoons.erase(i);
-					i--;
-				}
-				i->escapeDirection += (sunRadius/10.0f)/(float)std::pow(glm::distance(i->position, vec3(0, 0, 0)), 2) * -normalize(i->position);
-			}
 		}
-		if (fromShip) {
-			planetRotation += .01;
-		}
-
 		// ROCKETS
-		rocket->bind(texProg->getUniform("Texture0"));
-		for (vector<Rocket>::iterator i = rockets.begin(); i != rockets.end();) {
+		for (size_t k = 0; k < rockets.size();) {
+			Rocket *i = &rockets[k];
 			if (fromShip) {
 				i->update();
 			}
@@ -820,15 +1101,12 @@ public:
 			Model->rotate(i->rotation.z, vec3(0, 0, 1));
 			Model->rotate(i->rotation.x, vec3(1, 0, 0));
 			Model->scale(vec3(.05, .05, .05));
-			glUniformMatrix4fv(texProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-			for (int i = 0; i < meshes[13].first.size(); i++) {
-				meshes[13].first[i]->draw(texProg);
-			}
+			queue.submit(0, litProgram(true, i->position, meshes[13].second*.05f), rocket.get(), -1, meshes[13].first, Model->topMatrix(), distance(eye, i->position));
 			Model->popMatrix();
 			if (fromShip && i->life >= i->lifeEnd) {
-				rockets.erase(i);
+				rockets.removeAt(k);
 			} else {
-				i++;
+				k++;
 			}
 		}
 
@@ -839,34 +1117,54 @@ public:
 		Model->rotate(-lookPhi - uptilt, vec3(1, 0, 0));
 		Model->rotate(glm::clamp(-2*tilt, -PI/4, PI/4), vec3(0, 0, 1));
 		Model->scale(vec3(.15, .15, .15));
-		SetView(texProg);
-		glUniformMatrix4fv(texProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-		shipTextures[matIndex%8]->bind(texProg->getUniform("Texture0"));
-		for (int i = 0; i < meshes[5].first.size(); i++) {
-			meshes[5].first[i]->draw(texProg);
-		}
+		queue.submit(0, litProgram(true, position, meshes[5].second*.15f), shipTextures[matIndex%8].get(), -1, meshes[5].first, Model->topMatrix(), distance(eye, position));
 		Model->popMatrix();
-		texProg->unbind();
 
 		// ASTEROIDS
-		prog->bind();
-		SetMaterial(prog, 3);
 		for (int i = 0; i < asteroids.size(); i++) {
+			// composed as one translation, rotation and scale, then a single multiply
+			Transform orbit = Transform::rotate(asteroids[i].startAngle + asteroids[i].revolutionSpeed*planetRotation, vec3(0, 1, 0))
+				* Transform::translate(vec3(asteroids[i].radius, 0, 0))
+				* Transform::rotate(-asteroids[i].rotationSpeed*planetRotation, vec3(1, 0, 0))
+				* Transform::scaling(vec3(asteroids[i].size));
 			Model->pushMatrix();
-			Model->rotate(asteroids[i].startAngle + asteroids[i].revolutionSpeed*planetRotation, vec3(0, 1, 0));
-			Model->translate(vec3(asteroids[i].radius, 0, 0));
-			Model->rotate(-asteroids[i].rotationSpeed*planetRotation, vec3(1, 0, 0));
-			Model->scale(vec3(1, 1, 1)*asteroids[i].size);
-			glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-			for (int i = 0; i < meshes[6].first.size(); i++) {
-				meshes[6].first[i]->draw(prog);
-			}
+			Model->multMatrix(orbit.matrix());
+			vec3 center(Model->topMatrix()[3]);
+			queue.submit(0, litProgram(false, center, meshes[6].second*asteroids[i].size), nullptr, 3, meshes[6].first, Model->topMatrix(), distance(eye, center));
 			Model->popMatrix();
 		}
-		prog->unbind();
+
+		// OTHER SECTORS
+		const vector<unique_ptr<Universe::Sector> > &sectors = universe->sectors();
+		for (size_t s = 0; s < sectors.size(); s++) {
+			const vector<Universe::Body> &bodies = sectors[s]->bodies;
+			for (size_t i = 0; i < bodies.size(); i++) {
+				const Universe::Body &b = bodies[i];
+				float depth = distance(eye, b.position);
+				// past the far plane
+				if (depth > 1000.0f) {
+					continue;
+				}
+				bool planet = b.kind == Universe::Body::PLANET;
+				Transform t = Transform::translate(b.position)
+					* Transform::rotate(planetRotation*b.spin, planet ? vec3(0, 1, 0) : vec3(1, 0, 0))
+					* Transform::scaling(vec3(b.scale));
+				Model->pushMatrix();
+				Model->multMatrix(t.matrix());
+				if (planet) {
+					queue.submit(0, litProgram(true, b.position, meshes[12].second*b.scale), planetTextures[b.material].get(), -1, meshes[12].first, Model->topMatrix(), depth);
+				} else {
+					queue.submit(0, litProgram(false, b.position, meshes[6].second*b.scale), nullptr, 3, meshes[6].first, Model->topMatrix(), depth);
+				}
+				Model->popMatrix();
+			}
+		}
+
+		queue.execute([this](const shared_ptr<Program> &program, int material) { SetMaterial(program, material); });
 	}
 
 	void drawSun(shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		PROFILE_SCOPE("drawSun");
 		Model->pushMatrix();
 		texProgNoLighting->bind();
 		SetView(texProgNoLighting);
@@ -888,14 +1186,25 @@ public:
 	}
 
 	void drawParticles(shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective, glm::mat4 View) {
-		CHECKED_GL_CALL(glEnable(GL_DEPTH_TEST));
-		CHECKED_GL_CALL(glEnable(GL_BLEND));
-		CHECKED_GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+		PROFILE_SCOPE("drawParticles");
 		partProg->bind();
 		SetView(partProg);
 		CHECKED_GL_CALL(glUniformMatrix4fv(partProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix())));
 		CHECKED_GL_CALL(glUniformMatrix4fv(partProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix())));
-		for (vector<shared_ptr<particleSys> >::iterator i = particleSystems.begin(); i != particleSystems.end(); i++) {
+		// the sun's glow first, the rest blend over it
+		const Planet *beamSrc = planets.get(ufoSrc);
+		for (size_t k = 0; k <= particleSystems.size(); k++) {
+			shared_ptr<particleSys> *i;
+			if (k == 0) {
+				i = particleSystems.get(sunGlow);
+				if (!i) {
+					continue;
+				}
+			} else if (particleSystems.handle(k - 1) == sunGlow) {
+				continue;
+			} else {
+				i = &particleSystems[k - 1];
+			}
 			particleTextures[(*i)->textureIndex]->bind(partProg->getUniform("alphaTexture"));
 			(*i)->setCamera(View);
 			vec3 camPos(inverse(View)[3]);
@@ -903,23 +1212,189 @@ public:
 			(*i)->drawMe(partProg);
 			if (fromShip) {
 				(*i)->update();
-				if ((*i)->textureIndex == 1) {
-					(*i)->lock(ufoSrc->position + vec3(0, 5, 0));
+				if ((*i)->textureIndex == 1 && beamSrc) {
+					(*i)->lock(beamSrc->position + vec3(0, 5, 0));
 				}
-				if ((*i)->isDone()) {
-					particleSystems.erase(i);
-					i--;
+				if ((*i)->isDone() && k > 0) {
+					particleSystems.removeAt(k - 1);
+					k--;
 				}
 			}
 		}
 		partProg->unbind();
-		CHECKED_GL_CALL(glDisable(GL_DEPTH_TEST));
-		CHECKED_GL_CALL(glDisable(GL_BLEND));
-		CHECKED_GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+	}
+
+	void applyReplay()
+	{
+		const vector<InputEvent> &events = replay.eventsFor(simStep);
+		for (size_t i = 0; i < events.size(); i++) {
+			if (events[i].type == InputEvent::KEY) {
+				applyKey(events[i].key, events[i].action);
+			} else if (events[i].type == InputEvent::SCROLL) {
+				applyScroll(events[i].dx, events[i].dy);
+			}
+		}
+	}
+
+	// Renders the images of the portals visible from view that the portal
+	// budget allows, including the portals visible in those, and returns
+	// what to draw for each portal in view.
+	FrameVector<PortalDraw> renderPortals(const PortalView &view, shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		FrameVector<PortalDraw> draws = portals.gather(view, frameArena);
+		for (size_t i = 0; i < draws.size(); i++) {
+			const PortalDraw &d = draws[i];
+			if (!d.render) {
+				continue;
+			}
+			FrameVector<PortalDraw> inner = renderPortals(d.view, Model, Perspective);
+			PROFILE_SCOPE("wormholePass");
+			GLStateCache &state = graph.state();
+			state.bindFramebuffer(d.target->fbo);
+			state.viewport(0, 0, d.target->width/2, d.target->height/2);
+			state.apply(PassState::skybox());
+			glClearColor(0.0f, 0.0f, 1.0f, 0.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			fromShip = false;
+			passView = d.view.V;
+			passEye = d.view.eye;
+			drawSkybox(Model, Perspective);
+			state.apply(PassState::opaque());
+			drawEverythingElse(Model, Perspective);
+			drawSun(Model, Perspective);
+			drawPortals(d.view, inner, Model, Perspective);
+			// drawParticles(Model, Perspective, passView);
+			fromShip = true;
+			portals.rendered(d);
+			portals.release(inner);
+		}
+		return draws;
+	}
+
+	// Draws the portal spheres of a view, facing the view's heading. Uses
+	// the view matrix SetView picks, so call it from within the view's pass.
+	void drawPortals(const PortalView &view, const FrameVector<PortalDraw> &draws, shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		PROFILE_SCOPE("drawPortals");
+		portalProg->bind();
+		SetView(portalProg);
+		glUniformMatrix4fv(portalProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
+		for (size_t i = 0; i < draws.size(); i++) {
+			const PortalDraw &d = draws[i];
+			if (!d.target) {
+				continue;
+			}
+			mat3 reproject = portals.reprojection(d);
+			glUniformMatrix3fv(portalProg->getUniform("Reproject"), 1, GL_FALSE, value_ptr(reproject));
+			glBindTexture(GL_TEXTURE_2D, d.target->color);
+			portals.beginQuery(d);
+			drawPortalSphere(view, portals[d.portal], Model);
+			portals.endQuery(d);
+		}
+		portalProg->unbind();
+	}
+
+	// Draws a portal's sphere with the bound program, facing the view's heading
+	void drawPortalSphere(const PortalView &view, const Portal &portal, shared_ptr<MatrixStack> Model) {
+		float phi = asin(clamp(view.heading.y, -1.0f, 1.0f));
+		float theta = atan2(view.heading.z, view.heading.x);
+		Model->pushMatrix();
+		Model->translate(portal.src);
+		vec3 perp = portal.src - view.eye;
+		Model->rotate(-phi, vec3(perp.x * cos(-PI/2) - perp.z * sin(-PI/2), 0, perp.x * sin(-PI/2) + perp.z * cos(-PI/2)));
+		Model->rotate(-theta + PI, vec3(0, 1, 0));
+		Model->scale(vec3(portal.radius / meshes[12].second));
+		glUniformMatrix4fv(portalProg->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
+		for (int j = 0; j < meshes[12].first.size(); j++) {
+			meshes[12].first[j]->draw(portalProg);
+		}
+		Model->popMatrix();
+	}
+
+	// STENCIL mode: draws the view through each portal straight into the
+	// bound framebuffer, masked to the pixels of the portal's sphere. Leaves
+	// the spheres' depth behind like drawPortals() so later passes are hidden
+	// behind them.
+	void drawPortalsInPlace(const PortalView &view, const FrameVector<PortalDraw> &draws, shared_ptr<MatrixStack> Model, shared_ptr<MatrixStack> Perspective) {
+		PROFILE_SCOPE("drawPortalsInPlace");
+		GLStateCache &state = graph.state();
+		PassState mask = PassState::opaque();
+		mask.depthWrite = false;
+		PassState far = PassState::opaque();
+		far.depthFunc = GL_ALWAYS;
+		state.stencilTest(true);
+		for (size_t i = 0; i < draws.size(); i++) {
+			const PortalDraw &d = draws[i];
+			const Portal &portal = portals[d.portal];
+
+			// mark the visible pixels of the sphere, the query decides whether
+			// the view is drawn over the next frames
+			glClear(GL_STENCIL_BUFFER_BIT);
+			state.colorMask(false);
+			glStencilFunc(GL_ALWAYS, 1, 0xFF);
+			glStencilOp(GL_KEEP, GL_KEEP, d.render ? GL_REPLACE : GL_KEEP);
+			state.apply(mask);
+			portalProg->bind();
+			SetView(portalProg);
+			glUniformMatrix4fv(portalProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
+			portals.beginQuery(d);
+			drawPortalSphere(view, portal, Model);
+			portals.endQuery(d);
+			if (!d.render) {
+				portalProg->unbind();
+				state.colorMask(true);
+				continue;
+			}
+
+			// push the marked pixels to the far plane
+			glStencilFunc(GL_EQUAL, 1, 0xFF);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+			state.apply(far);
+			glDepthRange(1, 1);
+			drawPortalSphere(view, portal, Model);
+			glDepthRange(0, 1);
+			portalProg->unbind();
+
+			// the view through the portal
+			state.colorMask(true);
+			fromShip = false;
+			passView = d.view.V;
+			passEye = d.view.eye;
+			Perspective->pushMatrix();
+			Perspective->loadIdentity();
+			Perspective->multMatrix(d.view.P);
+			state.apply(PassState::skybox());
+			drawSkybox(Model, Perspective);
+			state.apply(PassState::opaque());
+			drawEverythingElse(Model, Perspective);
+			drawSun(Model, Perspective);
+			Perspective->popMatrix();
+			fromShip = true;
+
+			// put the sphere's depth back: far again, then the nearest face
+			state.colorMask(false);
+			state.apply(far);
+			portalProg->bind();
+			SetView(portalProg);
+			glUniformMatrix4fv(portalProg->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
+			glDepthRange(1, 1);
+			drawPortalSphere(view, portal, Model);
+			glDepthRange(0, 1);
+			state.apply(PassState::opaque());
+			drawPortalSphere(view, portal, Model);
+			portalProg->unbind();
+			state.colorMask(true);
+		}
+		state.stencilTest(false);
 	}
 
 	void render()
 	{
+		PROFILE_SCOPE("render");
+		if (replay.isOpen()) {
+			applyReplay();
+		}
+		if (bench) {
+			applyScenario();
+		}
 		if (abs(tilt) > .01) {
 			tilt -= .01*sign(tilt);
 		} else {
@@ -963,15 +1438,25 @@ public:
 			move = normalized;
 			position += normalized;
 		}
+		// cross before anything is drawn so all views of this frame agree on
+		// where the ship is
+		int crossed = portals.crossed(position, meshes[5].second*.05);
+		if (crossed >= 0) {
+			position = portals[crossed].dst;
+		}
+		updatePlanets();
+		universe->update(position);
+		gatherLights();
 		lookAt = position + vec3(10*cos(lookPhi)*cos(lookTheta), 10*sin(lookPhi), 10*cos(lookPhi)*cos(PI/2-lookTheta));
 
-		auto Model = make_shared<MatrixStack>();
-		auto View = make_shared<MatrixStack>();
-		auto Perspective = make_shared<MatrixStack>();
-		auto Perspective2 = make_shared<MatrixStack>();
+		shared_ptr<MatrixStack> Model = frameStacks[0];
+		shared_ptr<MatrixStack> View = frameStacks[1];
+		shared_ptr<MatrixStack> Perspective = frameStacks[2];
+		shared_ptr<MatrixStack> Perspective2 = frameStacks[3];
+		for (int i = 0; i < 4; i++) {
+			frameStacks[i]->reset();
+		}
 		glfwGetFramebufferSize(windowManager->getHandle(), &WIDTH, &HEIGHT);
-		glViewport(0, 0, WIDTH*fboRes, HEIGHT*fboRes);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		float aspect = WIDTH/(float)HEIGHT;
 		Perspective->pushMatrix();
@@ -980,59 +1465,89 @@ public:
 		Perspective2->perspective(fov * PI / 180, aspect, 0.1f, 1000.0f);
 		View->pushMatrix();
 		View->loadIdentity();
+		mark(Benchmark::UPDATE);
 
 		// draw everything to fbo
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glClearColor(0.0f, 0.0f, 1.0f, 0.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_DEPTH_TEST);
-		fromShip = false;
-		drawSkybox(Model, Perspective2);
-		drawEverythingElse(Model, Perspective2);
-        drawSun(Model, Perspective2);
-		// drawParticles(Model, Perspective2, wormHoleView);
-		fromShip = true;
+		renderTargets.resize(WIDTH, HEIGHT);
+		renderTargets.beginFrame();
+		int targetWidth = renderTargets.width();
+		int targetHeight = std::max(renderTargets.height(), 1);
+		portals.beginFrame(Perspective2->topMatrix(), std::min(2*targetWidth*fboRes, maxTextureSize), targetWidth/(float)targetHeight, (long long)targetWidth*targetHeight*fboRes*fboRes);
+		PortalView mainView;
+		mainView.P = Perspective->topMatrix();
+		mainView.V = shipView();
+		mainView.eye = position;
+		mainView.heading = normalize(lookAt - position);
+		mainView.height = HEIGHT;
+
+		graph.reset();
+		frameArena.reset();
+		graph.state().resetCounters();
+		FrameGraph::Resource backbuffer = graph.backbuffer(WIDTH, HEIGHT);
+		FrameGraph::Resource portalImages = graph.dependency("portalImages");
+		FrameVector<PortalDraw> portalDraws((FrameAllocator<PortalDraw>(frameArena)));
+		bool inPlace = portals.mode == PortalSystem::STENCIL;
 
-		glfwGetFramebufferSize(windowManager->getHandle(), &WIDTH, &HEIGHT);
-		glViewport(0, 0, WIDTH, HEIGHT);
-		
-		// draw texturecolorbuffer to wormhole
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glClearColor(1.0f, 1.0f, 1.0f, 1.0f); 
-        glClear(GL_COLOR_BUFFER_BIT);
-		glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
-        texProgNoLighting->bind();
-        Model->pushMatrix();
-        Model->translate(wormHoleSrc);
-		vec3 perp = wormHoleSrc - position;
-		Model->rotate(-lookPhi, vec3(perp.x * cos(-PI/2) - perp.z * sin(-PI/2), 0, perp.x * sin(-PI/2) + perp.z * cos(-PI/2)));
-		Model->rotate(-lookTheta + PI, vec3(0, 1, 0));
-        Model->scale(vec3(.2, .2, .2));
-		SetView(texProgNoLighting);
-		glUniformMatrix4fv(texProgNoLighting->getUniform("P"), 1, GL_FALSE, value_ptr(Perspective->topMatrix()));
-        glUniformMatrix4fv(texProgNoLighting->getUniform("M"), 1, GL_FALSE, value_ptr(Model->topMatrix()));
-        glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-        for (int i = 0; i < meshes[12].first.size(); i++) {
-            meshes[12].first[i]->draw(texProgNoLighting);
-        }
-        Model->popMatrix();
-        texProgNoLighting->unbind();
-		if (glm::distance(wormHoleSrc, position) < meshes[12].second*.2 + meshes[5].second*.05) {
-			position = wormHoleDst;
+		// draw everything to fbo
+		if (!inPlace) {
+			graph.addPass("wormholePass", [&]() {
+				PROFILE_GPU_SCOPE("wormholePass");
+				portalDraws = renderPortals(mainView, Model, Perspective2);
+				mark(Benchmark::PORTAL);
+			}).write(portalImages);
 		}
 
 		// draw normally
-		drawSkybox(Model, Perspective);
-		drawEverythingElse(Model, Perspective);
-        drawSun(Model, Perspective);
-		drawParticles(Model, Perspective, above->topMatrix());
+		graph.addPass("skybox", [&]() {
+			PROFILE_GPU_SCOPE("skybox");
+			drawSkybox(Model, Perspective);
+			mark(Benchmark::SKYBOX);
+		}).write(backbuffer).clear(1.0f, 1.0f, 1.0f, 1.0f).state(PassState::skybox());
+		graph.addPass("scene", [&]() {
+			PROFILE_GPU_SCOPE("scene");
+			drawEverythingElse(Model, Perspective);
+			mark(Benchmark::SCENE);
+		}).write(backbuffer).state(PassState::opaque()).keep();
+		graph.addPass("sun", [&]() {
+			PROFILE_GPU_SCOPE("sun");
+			drawSun(Model, Perspective);
+			mark(Benchmark::SUN);
+		}).write(backbuffer).state(PassState::opaque()).keep();
+
+		// draw texturecolorbuffer to wormholes, after the scene so the draws
+		// double as the occlusion queries for the next frames
+		if (!inPlace) {
+			graph.addPass("wormholeComposite", [&]() {
+				PROFILE_GPU_SCOPE("wormholeComposite");
+				drawPortals(mainView, portalDraws, Model, Perspective);
+				mark(Benchmark::PORTAL_COMPOSITE);
+			}).read(portalImages).write(backbuffer).state(PassState::opaque());
+		} else {
+			graph.addPass("wormholeStencil", [&]() {
+				PROFILE_GPU_SCOPE("wormholeStencil");
+				portalDraws = portals.gather(mainView, frameArena);
+				drawPortalsInPlace(mainView, portalDraws, Model, Perspective);
+				mark(Benchmark::PORTAL_COMPOSITE);
+			}).write(backbuffer).state(PassState::opaque()).keep();
+		}
+		graph.addPass("particles", [&]() {
+			PROFILE_GPU_SCOPE("particles");
+			drawParticles(Model, Perspective, above->topMatrix());
+			mark(Benchmark::PARTICLES);
+		}).write(backbuffer).state(PassState::alphaBlend()).keep();
+
+		bloom.addPasses(graph, backbuffer, renderTargets.width(), renderTargets.height());
+
+		graph.compile();
+		graph.execute();
+		mark(Benchmark::BLOOM);
 
 		View->popMatrix();
 		Perspective->popMatrix();
 		Perspective2->popMatrix();
 
+		renderTargets.endFrame();
+		simStep++;
 	}
 };
 
@@ -1040,21 +1555,99 @@ int main(int argc, char *argv[])
 {
 	// Where the resources are loaded from
 	std::string resourceDir = "../resources";
-
-	if (argc >= 2)
+	Application *application = new Application();
+	std::string recordPath;
+	std::string benchmarkOut;
+	Scenario scenario;
+	bool benchmarking = false;
+	bool dumpTrace = false;
+	bool allocCheck = false;
+	// frames before --alloc-check expects no more allocations: shaders
+	// linked, pools and arenas grown to size
+	const int allocWarmup = 120;
+	int frameCount = 0;
+	// steady-state frames that allocated, any of them fails the check
+	int allocatingFrames = 0;
+
+	for (int i = 1; i < argc; i++)
 	{
-		resourceDir = argv[1];
+		std::string arg = argv[i];
+		if (arg == "--microbench")
+		{
+			// CPU only, no window needed
+			return MicroBench::run(i + 1 < argc ? argv[i + 1] : "");
+		}
+		else if (arg == "--seed" && i + 1 < argc)
+		{
+			application->seed = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--record" && i + 1 < argc)
+		{
+			recordPath = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			if (!application->replay.open(argv[++i]))
+			{
+				return 1;
+			}
+			application->seed = application->replay.getSeed();
+		}
+		else if (arg == "--benchmark" && i + 1 < argc)
+		{
+			if (!scenario.load(argv[++i]))
+			{
+				return 1;
+			}
+			benchmarking = true;
+		}
+		else if (arg == "--benchmark-out" && i + 1 < argc)
+		{
+			benchmarkOut = argv[++i];
+		}
+		else if (arg == "--alloc-check")
+		{
+			allocCheck = true;
+		}
+		else if (arg == "--trace" && i + 1 < argc)
+		{
+			application->tracePath = argv[++i];
+			dumpTrace = true;
+		}
+		else
+		{
+			resourceDir = arg;
+		}
 	}
 
-	Application *application = new Application();
-
 	// Your main will always include a similar set up to establish your window
 	// and GL context, etc.
 
+	Benchmark benchmark(scenario);
+	if (benchmarking)
+	{
+		application->bench = &benchmark;
+		application->worldScale = scenario.scale;
+		if (scenario.hasSeed)
+		{
+			application->seed = scenario.seed;
+		}
+		if (benchmarkOut.empty())
+		{
+			benchmarkOut = "benchmark_" + scenario.name + ".json";
+		}
+	}
+
 	WindowManager *windowManager = new WindowManager();
 	windowManager->init(WIDTH, HEIGHT);
 	windowManager->setEventCallbacks(application);
+	ShaderCache::init("shadercache");
 	application->windowManager = windowManager;
+	if (benchmarking)
+	{
+		// measure what the machine can do, not the display's refresh rate
+		glfwSwapInterval(0);
+	}
 	vector<std::string> skyFaces = {
 		"right.jpg",
 		"left.jpg",
@@ -1070,20 +1663,101 @@ int main(int argc, char *argv[])
 
 	application->init(resourceDir);
 	application->initGeom(resourceDir);
+	application->finishPrograms();
+	if (benchmarking)
+	{
+		// time the whole scene, not the first frames with placeholders
+		application->loader.finish();
+	}
+	bool firstFrame = true;
+	bool assetsDone = false;
+
+	if (!recordPath.empty() && !application->replay.isOpen())
+	{
+		application->recorder.open(recordPath, application->seed);
+	}
+	double replayStart = glfwGetTime();
 
 	// Loop until the user closes the window.
 	while (! glfwWindowShouldClose(windowManager->getHandle()))
 	{
+		PROFILE_BEGIN_FRAME();
+		PROFILE_SCOPE("frame");
+		AllocationTracker::beginFrame();
+		if (benchmarking)
+		{
+			benchmark.beginFrame();
+		}
+
+		// Textures the loader threads have decoded
+		{
+			PROFILE_SCOPE("uploadAssets");
+			application->loader.update(0.004);
+		}
+
 		// Render scene.
 		application->render();
 
 		// Swap front and back buffers.
-		glfwSwapBuffers(windowManager->getHandle());
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
+			glfwSwapBuffers(windowManager->getHandle());
+		}
 		// Poll for and process events.
 		glfwPollEvents();
+
+		if (firstFrame)
+		{
+			cout << "First frame after " << glfwGetTime() << " s" << endl;
+			firstFrame = false;
+		}
+		if (!assetsDone && application->loader.pending() == 0)
+		{
+			cout << "All assets loaded after " << glfwGetTime() << " s" << endl;
+			assetsDone = true;
+		}
+
+		if (allocCheck && ++frameCount > allocWarmup)
+		{
+			AllocationTracker::Counts allocated = AllocationTracker::endFrame();
+			if (allocated.allocations > 0)
+			{
+				allocatingFrames++;
+				cerr << "frame " << frameCount << ": " << allocated.allocations << " allocations, " << allocated.bytes << " bytes" << endl;
+			}
+		}
+
+		if (benchmarking)
+		{
+			benchmark.mark(Benchmark::SWAP);
+			benchmark.endFrame();
+			if (benchmark.done())
+			{
+				benchmark.writeReport(benchmarkOut, application->seed, (const char *)glGetString(GL_RENDERER));
+				glfwSetWindowShouldClose(windowManager->getHandle(), GL_TRUE);
+			}
+		}
+
+		if (application->replay.finished(application->simStep))
+		{
+			double elapsed = glfwGetTime() - replayStart;
+			cout << "Replayed " << application->simStep << " steps in " << elapsed << " s ("
+				<< 1000.0 * elapsed / application->simStep << " ms/frame)" << endl;
+			glfwSetWindowShouldClose(windowManager->getHandle(), GL_TRUE);
+		}
+	}
+	application->recorder.close(application->simStep);
+	if (dumpTrace)
+	{
+		Profiler::dump(application->tracePath);
 	}
 
 	// Quit program.
 	windowManager->shutdown();
+	if (allocCheck && allocatingFrames > 0)
+	{
+		cerr << allocatingFrames << " of " << std::max(0, frameCount - allocWarmup) << " frames after warm-up allocated" << endl;
+		return 1;
+	}
 	return 0;
 }
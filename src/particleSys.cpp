@@ -5,7 +5,6 @@
 #include <glm/gtx/quaternion.hpp>
 #include "particleSys.h"
 #include "GLSL.h"
-#include <glm/gtc/random.hpp>
 
 
 
@@ -23,21 +22,25 @@ particleSys::particleSys(vec3 source, int textureIndex, int numP, float radius,
   this->vMax = vMax;
   this->c = c;
   this->life = life;
+  generation = 0;
 	theCamera = glm::mat4(1.0);
 }
 
 void particleSys::gpuSetup() {
 
   // cout << "start: " << start.x << " " << start.y << " " <<start.z << endl;
+	particles.resize(numP);
+	order.resize(numP);
+	depth.resize(numP);
+	numDone = 0;
 	for (int i=0; i < numP; i++) {
 		points[i*3+0] = start.x;
 		points[i*3+1] = start.y;
 		points[i*3+2] = start.z;
 
-		auto particle = make_shared<Particle>(start);
-		particles.push_back(particle);
-		particle->load(start, radius, bias, vMax, c, life);
+		order[i] = i;
 	}
+	rebirthAll();
 
 	//generate the VAO
    glGenVertexArrays(1, &vertArrObj);
@@ -57,11 +60,35 @@ void particleSys::gpuSetup() {
 	
 }
 
+/* same distribution as Particle::rebirth, batch filled straight into the
+   SoA block. Every (re)birth draws from its own substream of the emitter's
+   stream so the result never depends on who spawned what first. */
+void particleSys::rebirthAll() {
+	RandomStream r = random.substream(generation++);
+	for (int i = 0; i < numP; i++) {
+		vec3 x = start + (radius == 0 ? vec3(0, 0, 0) : r.ballRand(radius));
+		particles.x[i] = x.x;
+		particles.y[i] = x.y;
+		particles.z[i] = x.z;
+	}
+	r.fill(&particles.vx[0], numP, bias.x - vMax.x, bias.x + vMax.x);
+	r.fill(&particles.vy[0], numP, bias.y - vMax.y, bias.y + vMax.y);
+	r.fill(&particles.vz[0], numP, bias.z - vMax.z, bias.z + vMax.z);
+	r.fill(&particles.tEnd[0], numP, t + life.s, t + life.s + life.t);
+	r.fill(&particles.r[0], numP, c.r - .1f, c.r + .1f);
+	r.fill(&particles.g[0], numP, c.g - .1f, c.g + .1f);
+	r.fill(&particles.b[0], numP, c.b - .1f, c.b + .1f);
+	for (int i = 0; i < numP; i++) {
+		particles.invLife[i] = 1.0f / (particles.tEnd[i] - t);
+		particles.alpha[i] = 1.0f;
+		particles.dead[i] = 0.0f;
+	}
+}
+
 void particleSys::reSet() {
   cout << "reset" << endl;
-	for (int i=0; i < numP; i++) {
-		particles[i]->load(start, radius, bias, vMax, c, life);
-	}
+	rebirthAll();
+	numDone = 0;
 }
 
 void particleSys::drawMe(std::shared_ptr<Program> prog) {
@@ -89,28 +116,23 @@ void particleSys::drawMe(std::shared_ptr<Program> prog) {
 }
 
 bool particleSys::isDone() {
-  return doneParticles.size() == numP;
+  return numDone == numP;
 }
 
 void particleSys::lock(vec3 pos) {
-  for (vector<shared_ptr<Particle> >::iterator i = particles.begin(); i != particles.end(); i++) {
-      (*i)->lock(t, pos);
+  for (int i = 0; i < numP; i++) {
+      particles.x[i] = pos.x;
+      particles.y[i] = pos.y;
+      particles.z[i] = pos.z;
+      particles.alpha[i] = 1.0f;
   }
   start = pos;
 }
 
 void particleSys::update() {
 
-  vec3 pos;
-  vec4 col;
-
-  //update the particles
-  for (vector<shared_ptr<Particle> >::iterator i = particles.begin(); i != particles.end(); i++) {
-      (*i)->update(t, h, g, start);
-      if ((*i)->done) {
-        doneParticles.insert(*i);
-      }
-  }
+  //update the particles, 8 at a time where the CPU allows it
+  numDone = (int)ParticleKernel::integrate(particles, t, h);
   t += h;
  
   // Sort the particles by Z
@@ -120,22 +142,24 @@ void particleSys::update() {
   vec4 p;
   quat r;
   glm::decompose(theCamera, s, r, t, sk, p);
-  sorter.C = glm::toMat4(r); 
-  sort(particles.begin(), particles.end(), sorter);
+  mat4 C = glm::toMat4(r);
+  for (int i = 0; i < numP; i++) {
+      depth[i] = C[0][2]*particles.x[i] + C[1][2]*particles.y[i] + C[2][2]*particles.z[i] + C[3][2];
+  }
+  sorter.depth = &depth;
+  sort(order.begin(), order.end(), sorter);
 
 
   //go through all the particles and update the CPU buffer
    for (int i = 0; i < numP; i++) {
-        pos = particles[i]->getPosition();
-        col = particles[i]->getColor();
-        points[i*3+0] =pos.x; 
-        points[i*3+1] =pos.y; 
-        points[i*3+2] =pos.z; 
-			  // To do - how can you integrate unique colors per particle?
-        pointColors[i*4+0] = col.r;
-        pointColors[i*4+1] = col.g;
-        pointColors[i*4+2] = col.b;
-        pointColors[i*4+3] = col.a;
+        unsigned j = order[i];
+        points[i*3+0] = particles.x[j];
+        points[i*3+1] = particles.y[j];
+        points[i*3+2] = particles.z[j];
+        pointColors[i*4+0] = particles.r[j];
+        pointColors[i*4+1] = particles.g[j];
+        pointColors[i*4+2] = particles.b[j];
+        pointColors[i*4+3] = particles.alpha[j];
   } 
 
   //update the GPU data
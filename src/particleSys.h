@@ -4,8 +4,9 @@
 
 #include <glm/glm.hpp>
 #include <vector>
-#include <unordered_set>
-#include "Particle.h"
+#include <memory>
+#include "ParticleKernel.h"
+#include "Random.h"
 #include "Program.h"
 
 using namespace glm;
@@ -13,26 +14,24 @@ using namespace std;
 
 class ParticleSorter {
 public:
-   bool operator()(const shared_ptr<Particle> p0, const shared_ptr<Particle> p1) const
+   // Compares particle indices by their precomputed camera space depth
+   bool operator()(unsigned i0, unsigned i1) const
    {
-      // Particle positions in world space
-      const vec3 &x0 = p0->getPosition();
-      const vec3 &x1 = p1->getPosition();
-      // Particle positions in camera space
-      vec4 x0w = C * vec4(x0.x, x0.y, x0.z, 1.0f);
-      vec4 x1w = C * vec4(x1.x, x1.y, x1.z, 1.0f);
-      return x0w.z < x1w.z;
+      return (*depth)[i0] < (*depth)[i1];
    }
-  
-   mat4 C; // current camera matrix
+
+   const vector<float> *depth;
 };
 
 class particleSys {
 private:
-	vector<shared_ptr<Particle> > particles;
+	ParticleBlock particles;
+	vector<unsigned> order; // draw order, back to front
+	vector<float> depth;    // camera space depth per particle
 	float t, h; //?
 	vec3 g; //gravity
 	int numP;
+	int numDone;
 	ParticleSorter sorter;
 	//this is not great that this is hard coded - you can make it better
 	GLfloat points[900];
@@ -46,12 +45,20 @@ private:
 	vec3 vMax;
 	vec3 c;
 	vec2 life;
+	RandomStream random;
+	unsigned generation;
+	void rebirthAll();
 	
 public:
 	particleSys(vec3 source, int textureIndex, int numP, float radius, vec3 bias, vec3 vMax, vec3 c, vec2 life, float scale);
 	vec3 start;
 	int textureIndex;
 	float scale;
+	// how far the emitter lights its surroundings, 0 for not at all
+	float lightRadius = 0;
+	vec3 color() const {return c;}
+	// share of particles still alive
+	float alive() const {return numP ? 1.0f - numDone/(float)numP : 0.0f;}
 	void drawMe(std::shared_ptr<Program> prog);
 	void gpuSetup();
 	void lock(vec3 pos);
@@ -59,7 +66,8 @@ public:
 	bool isDone();
 	void reSet();
 	void setCamera(mat4 inC) {theCamera = inC;}
-	unordered_set<shared_ptr<Particle> > doneParticles;
+	// Stream this emitter draws its particles from; set before gpuSetup()
+	void setRandom(const RandomStream &r) {random = r;}
 };
 
 